@@ -0,0 +1,601 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	codec microbenchmark: encodes/decodes corpora of messages (each
+ *	a traffic mix) and prints one tab separated line per (proto, op,
+ *	corpus, message id), timing the messages of each id apart:
+ *
+ *	proto op corpus msg msgs msgs_per_sec ns_per_msg allocs_per_msg
+ *
+ *	(msg is "-" for the malformed corpus, that is timed as a whole)
+ *
+ *	patch fills in templates prepared per message id (with src,
+ *	text and mode as slots), as qcs_send_prepared() does
+ *
+ *	loop_* ops send the corpus through a link over loopback and
+ *	receive it back, with each I/O backend in turn; segment_hosts
+ *	broadcasts it to SEGMENT_HOSTS links on an in-process segment
+ *	(msgs counts the messages received by all of them)
+ *
+ *	usage: qcs_bench [seconds per line]
+ *	(link with -Wl,--wrap=malloc,--wrap=calloc to count allocations)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "qcs_link.h"
+#include "qcs_schema.h"
+#include "supp.h"
+#include "link.h"
+#include "codec.h"
+#include "p_qchat.h"
+#include "p_vypress.h"
+
+#define CORPUS_SIZE	0x40
+
+/* port of loop_* links (plus proto) */
+#define LOOP_PORT	18460
+
+/* links of the segment_hosts op */
+#define SEGMENT_HOSTS	100
+
+/* slots of the patch op templates */
+#define PATCH_SLOTS	(QCS_SLOT(QCS_SRC) | QCS_SLOT(QCS_TEXT) | QCS_SLOT_MODE)
+
+/* allocation counting */
+static unsigned long alloc_count = 0;
+
+void * __real_malloc(size_t);
+void * __real_calloc(size_t, size_t);
+
+void * __wrap_malloc(size_t size)
+{
+	alloc_count ++;
+	return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t nmemb, size_t size)
+{
+	alloc_count ++;
+	return __real_calloc(nmemb, size);
+}
+
+/* corpus:
+ *	messages and their encoded datagrams	*/
+struct corpus {
+	const char * name;
+	enum qcs_msgid msg;	/* of every entry, QCS_MSG_INVALID - mixed */
+	int count;
+	qcs_msg * msgs[CORPUS_SIZE];
+	char dgrams[CORPUS_SIZE][QCP_MAXDGRAMSIZE];
+	size_t lens[CORPUS_SIZE];
+};
+
+/* template:
+ *	prepared message of the patch op	*/
+struct template {
+	size_t len;		/* 0 - not prepared yet */
+	int n_slots;
+	struct qcs__slot slots[QCS_PREPARED_SLOTS];
+	char buf[QCP_MAXDGRAMSIZE];
+};
+
+enum bench_op { OP_ENCODE, OP_PATCH, OP_DECODE, OP_DECODE_MSG, OP_PEEK };
+static const char * op_names[] = {
+	"encode", "patch", "decode", "decode_msg", "peek" };
+static const char * loop_names[] = {	/* by backend */
+	"loop_sockets", "loop_uring", "loop_segment" };
+static const char * proto_names[] = { "qchat", "vypress" };
+
+/* msg_names:
+ *	message id names, by id (both protocols have the same ids) */
+#define MSG_NAME(id, op, sub, fields, consts)	[QCS_MSG_##id] = #id,
+static const char * msg_names[QCS_SCHEMA_MSGS] = {
+	QCS_SCHEMA_COMMON(MSG_NAME)
+	QCS_SCHEMA_QCHAT(MSG_NAME)
+};
+
+static double bench_seconds = 0.2;
+static unsigned int sig_seed = 1;
+static unsigned long sig_counter = 0;
+static struct qcs__dup_cache dup_cache;
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* stamp_signature:
+ *	gives the datagram an unseen vypress signature,
+ *	so it gets past the duplicate cache	*/
+static void stamp_signature(char * dgram)
+{
+	unsigned long n = sig_counter++;
+	int i;
+
+	for(i = 1; i <= QCS_SIGNATURE_LENGTH; i++) {
+		dgram[i] = 'a' + n % 26;
+		n /= 26;
+	}
+}
+
+static qcs_msg * new_msg(
+	enum qcs_msgid id, int mode,
+	const char * src, const char * dst,
+	const char * text, const char * supp, const char * chan )
+{
+	qcs_msg * msg = qcs_newmsg();
+
+	msg->msg = id;
+	msg->mode = mode;
+	if(src) qcs_msgset(msg, QCS_SRC, src);
+	if(dst) qcs_msgset(msg, QCS_DST, dst);
+	if(text) qcs_msgset(msg, QCS_TEXT, text);
+	if(supp) qcs_msgset(msg, QCS_SUPP, supp);
+	if(chan) qcs_msgset(msg, QCS_CHAN, chan);
+	return msg;
+}
+
+static int encode(int proto, const qcs_msg * msg, char * buf, size_t * p_len)
+{
+	qcs_msg_view view;
+
+	/* as qcs_send() does */
+	qcs__viewmsg(msg, &view);
+	return proto==QCS_PROTO_VYPRESS
+		? qcs__encode_vypress(&view, buf, QCP_MAXDGRAMSIZE, p_len, &sig_seed)
+		: qcs__encode_qchat(&view, buf, QCP_MAXUDPSIZE, p_len);
+}
+
+/* prepare:
+ *	templates of the corpus messages, by message id	*/
+static void prepare(int proto, struct corpus * c, struct template * tmpls)
+{
+	struct template * t;
+	qcs_msg_view view;
+	int i;
+
+	for(i = 0; i < QCS_SCHEMA_MSGS; i++) {
+		tmpls[i].len = 0;
+	}
+	for(i = 0; i < c->count; i++) {
+		t = tmpls + c->msgs[i]->msg;
+		if(t->len) {
+			continue;
+		}
+		qcs__viewmsg(c->msgs[i], &view);
+		if(!(proto==QCS_PROTO_VYPRESS
+			? qcs__prepare_vypress(&view, PATCH_SLOTS, t->slots,
+				&t->n_slots, t->buf, QCP_MAXDGRAMSIZE, &t->len)
+			: qcs__prepare_qchat(&view, PATCH_SLOTS, t->slots,
+				&t->n_slots, t->buf, QCP_MAXUDPSIZE, &t->len)))
+		{
+			fprintf(stderr, "bench: cannot prepare %s/%d: %s\n",
+				c->name, i, strerror(errno));
+			exit(1);
+		}
+	}
+}
+
+static int patch(int proto, const struct template * t,
+	const qcs_msg * msg, char * buf, size_t * p_len)
+{
+	qcs_msg_view view;
+
+	/* as qcs_send_prepared() does, with the slots in view */
+	view.mode = msg->mode;
+	view.src.str = msg->src;
+	view.src.len = msg->src ? strlen(msg->src): 0;
+	view.text.str = msg->text;
+	view.text.len = msg->text ? strlen(msg->text): 0;
+	if(!qcs__patch_msg(t->buf, t->len, t->slots, t->n_slots, &view, buf,
+		proto==QCS_PROTO_VYPRESS ? QCP_MAXDGRAMSIZE: QCP_MAXUDPSIZE,
+		p_len))
+	{
+		return 0;
+	}
+	if(proto==QCS_PROTO_VYPRESS) {
+		qcs__generate_signature(buf, &sig_seed);
+	}
+	return 1;
+}
+
+static int decode(int proto, char * dgram, size_t len, qcs_msg_view * view)
+{
+	if(proto==QCS_PROTO_VYPRESS) {
+		stamp_signature(dgram);
+		return qcs__parse_vypress_view(dgram, len, view,
+			&dup_cache, NULL);
+	}
+	return qcs__parse_qchat_view(dgram, len, view, NULL);
+}
+
+/* build_corpus:
+ *	fills in corpus, that may be encoded with proto	*/
+static void build_corpus(struct corpus * c, int proto, const char * name)
+{
+	char nick[32], text[400], chans[300];
+	int i;
+
+	c->name = name;
+	c->msg = QCS_MSG_INVALID;
+	c->count = 0;
+
+	if(!strcmp(name, "refresh")) {
+		/* refresh storm: a request and everyone replying */
+		c->msgs[c->count++] = new_msg(QCS_MSG_REFRESH_REQUEST,
+			0, "newcomer", NULL, NULL, NULL, NULL);
+		for(i = 1; i < CORPUS_SIZE; i++) {
+			sprintf(nick, "user%03d", i);
+			c->msgs[c->count++] = new_msg(QCS_MSG_REFRESH_ACK,
+				QCS_UMODE_NORMAL + i % 4, nick, "newcomer",
+				NULL, NULL, NULL);
+		}
+	}
+	else if(!strcmp(name, "chantext")) {
+		/* long channel text */
+		for(i = 0; i < (int)sizeof(text) - 1; i++) {
+			text[i] = 'a' + i % 26;
+		}
+		text[sizeof(text) - 1] = '\0';
+
+		for(i = 0; i < CORPUS_SIZE; i++) {
+			sprintf(nick, "talker%d", i % 8);
+			text[i] = ' ';
+			c->msgs[c->count++] = new_msg(
+				i % 4 ? QCS_MSG_CHANNEL_BROADCAST: QCS_MSG_CHANNEL_ME,
+				0, nick, NULL, text, NULL, "Main");
+		}
+	}
+	else if(!strcmp(name, "inforeply")) {
+		/* INFO_REPLY with big channel list */
+		strcpy(chans, "#Main#");
+		for(i = 0; strlen(chans) < sizeof(chans) - 16; i++) {
+			sprintf(chans + strlen(chans), "channel%02d#", i);
+		}
+		for(i = 0; i < CORPUS_SIZE; i++) {
+			sprintf(nick, "user%03d", i);
+			c->msgs[c->count++] = new_msg(QCS_MSG_INFO_REPLY,
+				0, nick, "asker", "login", "away for lunch",
+				chans);
+		}
+	}
+
+	for(i = 0; i < c->count; i++) {
+		if(!encode(proto, c->msgs[i], c->dgrams[i], c->lens + i)) {
+			fprintf(stderr, "bench: cannot encode %s/%d: %s\n",
+				name, i, strerror(errno));
+			exit(1);
+		}
+	}
+}
+
+/* build_malformed:
+ *	truncated, mangled and unknown datagrams (decode only) */
+static void build_malformed(struct corpus * c, int proto)
+{
+	struct corpus valid;
+	int i, head;
+
+	build_corpus(&valid, proto, "inforeply");
+
+	c->name = "malformed";
+	c->msg = QCS_MSG_INVALID;
+	c->count = 0;
+	head = proto==QCS_PROTO_VYPRESS ? QCS_SIGNATURE_LENGTH + 1: 0;
+
+	for(i = 0; i < CORPUS_SIZE; i++) {
+		c->msgs[i] = NULL;
+		memcpy(c->dgrams[i], valid.dgrams[i], valid.lens[i]);
+		c->lens[i] = valid.lens[i];
+
+		switch(i % 4) {
+		case 0:	/* truncated in the middle of a field */
+			c->lens[i] = head + 1 + i % 20;
+			break;
+		case 1:	/* terminator of the last field missing */
+			c->lens[i] --;
+			break;
+		case 2:	/* unknown opcode */
+			c->dgrams[i][head] = 'z';
+			break;
+		case 3:	/* unknown subcode */
+			c->dgrams[i][head] = 'J';
+			c->dgrams[i][head + 1] = '9';
+			break;
+		}
+		c->count ++;
+	}
+
+	for(i = 0; i < valid.count; i++) {
+		qcs_deletemsg(valid.msgs[i]);
+	}
+}
+
+/* split_corpus:
+ *	fills in sub with the entries of c, that are message id
+ * returns:
+ *	number of them	*/
+static int split_corpus(
+	const struct corpus * c,
+	enum qcs_msgid id,
+	struct corpus * sub )
+{
+	int i;
+
+	sub->name = c->name;
+	sub->msg = id;
+	sub->count = 0;
+	for(i = 0; i < c->count; i++) {
+		if(c->msgs[i]->msg!=id) {
+			continue;
+		}
+		sub->msgs[sub->count] = c->msgs[i];
+		memcpy(sub->dgrams[sub->count], c->dgrams[i], c->lens[i]);
+		sub->lens[sub->count] = c->lens[i];
+		sub->count ++;
+	}
+	return sub->count;
+}
+
+static void print_result(
+	int proto, const char * op,
+	const struct corpus * c,
+	unsigned long n, double elapsed, unsigned long allocs )
+{
+	printf("%s\t%s\t%s\t%s\t%lu\t%.0f\t%.1f\t%.2f\n",
+		proto_names[proto], op, c->name,
+		c->msg==QCS_MSG_INVALID ? "-": msg_names[c->msg], n,
+		n / elapsed, elapsed * 1e9 / n, (double)allocs / n);
+}
+
+static void run(int proto, enum bench_op op, struct corpus * c)
+{
+	static struct template tmpls[QCS_SCHEMA_MSGS];
+	char buf[QCP_MAXDGRAMSIZE];
+	qcs_msg_view view;
+	qcs_msg_peek peek;
+	qcs_msg * msg = qcs_newmsg();
+	unsigned long n = 0, allocs;
+	double start, elapsed;
+	size_t len;
+	int i;
+
+	if(op==OP_PATCH) {
+		prepare(proto, c, tmpls);
+	}
+
+	allocs = alloc_count;
+	start = now();
+	do {
+		for(i = 0; i < c->count; i++) {
+			switch(op) {
+			case OP_ENCODE:
+				encode(proto, c->msgs[i], buf, &len);
+				break;
+			case OP_PATCH:
+				patch(proto, tmpls + c->msgs[i]->msg,
+					c->msgs[i], buf, &len);
+				break;
+			case OP_DECODE:
+				decode(proto, c->dgrams[i], c->lens[i], &view);
+				break;
+			case OP_DECODE_MSG:
+				if(decode(proto, c->dgrams[i], c->lens[i], &view)) {
+					qcs__materialize(&view, msg);
+				}
+				break;
+			case OP_PEEK:
+				qcs_peek(proto, c->dgrams[i], c->lens[i], &peek);
+				break;
+			}
+		}
+		n += c->count;
+		elapsed = now() - start;
+	} while(elapsed < bench_seconds);
+	allocs = alloc_count - allocs;
+
+	print_result(proto, op_names[op], c, n, elapsed, allocs);
+
+	qcs_deletemsg(msg);
+}
+
+/* run_loop:
+ *	sends the corpus to ourselves, over a link on `backend',
+ *	and receives it back, again and again	*/
+static void run_loop(int proto, int backend, struct corpus * c)
+{
+	static const unsigned long loopback[] = { 0x7f000001UL, 0UL };
+	qcs_msg * msgs[QCS_RECV_BATCH];
+	qcs_link_opts opts;
+	qcs_link link;
+	unsigned long n = 0, allocs;
+	double start, elapsed;
+	int i, got, count, used;
+
+	qcs_initopts(&opts);
+	opts.backend = backend;
+	if(backend==QCS_BACKEND_SEGMENT) {
+		opts.segment = qcs_newsegment();
+		if(opts.segment==NULL) {
+			perror("bench");
+			exit(1);
+		}
+	}
+	link = qcs_open_ex(proto, loopback, LOOP_PORT + proto, &opts);
+	if(link==NULL) {
+		fprintf(stderr, "bench: cannot open link: %s\n", strerror(errno));
+		exit(1);
+	}
+	if(qcs_backend(link, &used) && used!=backend) {
+		fprintf(stderr, "bench: %s: backend not available\n",
+			loop_names[backend]);
+		qcs_close(link);
+		return;
+	}
+	for(i = 0; i < QCS_RECV_BATCH; i++) {
+		msgs[i] = qcs_newmsg();
+	}
+
+	allocs = alloc_count;
+	start = now();
+	do {
+		qcs_send_batch(link, (const qcs_msg * const *)c->msgs, c->count);
+		for(got = 0; got < c->count; got += count) {
+			if(qcs_waitinput(link, 1000) <= 0
+				|| !qcs_recv_batch(link, msgs, QCS_RECV_BATCH, &count))
+			{
+				fprintf(stderr, "bench: %s/%s: lost %d datagrams\n",
+					loop_names[backend], c->name, c->count - got);
+				break;
+			}
+		}
+		n += got;
+		elapsed = now() - start;
+	} while(elapsed < bench_seconds);
+	allocs = alloc_count - allocs;
+
+	print_result(proto, loop_names[backend], c, n, elapsed, allocs);
+
+	for(i = 0; i < QCS_RECV_BATCH; i++) {
+		qcs_deletemsg(msgs[i]);
+	}
+	qcs_close(link);
+	if(opts.segment) {
+		qcs_deletesegment(opts.segment);
+	}
+}
+
+/* run_segment_hosts:
+ *	broadcasts the corpus from the first of SEGMENT_HOSTS links
+ *	on an in-process segment, and receives it on every one	*/
+static void run_segment_hosts(int proto, struct corpus * c)
+{
+	static const unsigned long broadcast[] = { 0xffffffffUL, 0UL };
+	static qcs_link links[SEGMENT_HOSTS];
+	qcs_msg * msgs[QCS_RECV_BATCH];
+	qcs_link_opts opts;
+	unsigned long n = 0, allocs;
+	double start, elapsed;
+	int i, h, got, count;
+
+	qcs_initopts(&opts);
+	opts.backend = QCS_BACKEND_SEGMENT;
+	opts.segment = qcs_newsegment();
+	if(opts.segment==NULL) {
+		perror("bench");
+		exit(1);
+	}
+	for(h = 0; h < SEGMENT_HOSTS; h++) {
+		links[h] = qcs_open_ex(proto, broadcast, LOOP_PORT + proto, &opts);
+		if(links[h]==NULL) {
+			fprintf(stderr, "bench: cannot open link: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+	}
+	for(i = 0; i < QCS_RECV_BATCH; i++) {
+		msgs[i] = qcs_newmsg();
+	}
+
+	allocs = alloc_count;
+	start = now();
+	do {
+		qcs_send_batch(links[0], (const qcs_msg * const *)c->msgs, c->count);
+		for(h = 0; h < SEGMENT_HOSTS; h++) {
+			for(got = 0; got < c->count; got += count) {
+				if(!qcs_recv_batch(links[h], msgs, QCS_RECV_BATCH, &count)) {
+					fprintf(stderr, "bench: segment_hosts/%s: "
+						"lost %d datagrams\n",
+						c->name, c->count - got);
+					break;
+				}
+			}
+			n += got;
+		}
+		elapsed = now() - start;
+	} while(elapsed < bench_seconds);
+	allocs = alloc_count - allocs;
+
+	print_result(proto, "segment_hosts", c, n, elapsed, allocs);
+
+	for(i = 0; i < QCS_RECV_BATCH; i++) {
+		qcs_deletemsg(msgs[i]);
+	}
+	for(h = 0; h < SEGMENT_HOSTS; h++) {
+		qcs_close(links[h]);
+	}
+	qcs_deletesegment(opts.segment);
+}
+
+int main(int argc, char ** argv)
+{
+	static const char * corpora[] = { "refresh", "chantext", "inforeply" };
+	static struct corpus c, sub;
+	int proto, i, id;
+
+	if(argc > 1) {
+		bench_seconds = atof(argv[1]);
+	}
+	if(!qcs__dup_init(&dup_cache, QCS_DUP_CACHE_SIZE)) {
+		perror("bench");
+		return 1;
+	}
+
+	printf("proto\top\tcorpus\tmsg\tmsgs\tmsgs_per_sec\tns_per_msg\tallocs_per_msg\n");
+
+	for(proto = QCS_PROTO_QCHAT; proto <= QCS_PROTO_VYPRESS; proto++) {
+		for(i = 0; i < (int)(sizeof(corpora) / sizeof(corpora[0])); i++) {
+			build_corpus(&c, proto, corpora[i]);
+			for(id = 0; id < QCS_SCHEMA_MSGS; id++) {
+				if(!split_corpus(&c, id, &sub)) {
+					continue;
+				}
+				run(proto, OP_ENCODE, &sub);
+				run(proto, OP_PATCH, &sub);
+				run(proto, OP_DECODE, &sub);
+				run(proto, OP_DECODE_MSG, &sub);
+				run(proto, OP_PEEK, &sub);
+				run_loop(proto, QCS_BACKEND_SOCKETS, &sub);
+				run_loop(proto, QCS_BACKEND_URING, &sub);
+				run_loop(proto, QCS_BACKEND_SEGMENT, &sub);
+				run_segment_hosts(proto, &sub);
+			}
+			for(; c.count; c.count--) {
+				qcs_deletemsg(c.msgs[c.count - 1]);
+			}
+		}
+
+		build_malformed(&c, proto);
+		run(proto, OP_DECODE, &c);
+		run(proto, OP_PEEK, &c);
+	}
+
+	qcs__dup_free(&dup_cache);
+	return 0;
+}
@@ -24,22 +24,41 @@
  * (c) Saulius Menkevicius 2001,2002
  */
 
+#define _GNU_SOURCE	/* recvmmsg() */
+
 #include <assert.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#include <linux/io_uring.h>
 
 #include "qcs_link.h"
-#include "link.h"
+#include "qcs_schema.h"
 #include "supp.h"
+#include "uring.h"
+#include "segment.h"
+#include "link.h"
+#include "codec.h"
 #include "p_vypress.h"
 #include "p_qchat.h"
 
@@ -47,9 +66,23 @@
 #define ERRRET(err)	if(1){errno=(err);return(0);}
 #define ACTIVE_LINK(l)	((l)->rx >=0)
 #define INVALIDATE(l)	((l)->rx=-1)
+#define RX_POLLFD(l)	((l)->rx_ring ? (l)->rx_ring->fd: (l)->rx)
+
+/* epoll data tag of link send timers & tx sockets in a linkset:
+ * their links are to be flushed, not reported */
+#define LINKSET_FLUSH	((uint64_t)1)
 
-/** static variables */
-static int link_count = 0;
+/* room for receive time, destination & kernel drop count of a datagram */
+#define RX_CTRL_SIZE	(CMSG_SPACE(sizeof(struct timespec)) \
+			+ CMSG_SPACE(sizeof(struct in_pktinfo)) \
+			+ CMSG_SPACE(sizeof(uint32_t)))
+
+/* size of rx ring buffer: multishot recvmsg puts there its header,
+ * source address & control data (as much room, as the template has
+ * for them), followed by the datagram */
+#define RX_RING_BUF_SIZE	(sizeof(struct io_uring_recvmsg_out) \
+			+ sizeof(struct sockaddr_in) + RX_CTRL_SIZE \
+			+ QCP_MAXUDPSIZE)
 
 /** internal implementation routines	*/
 
@@ -98,15 +131,206 @@ static unsigned long *
 	return list;
 }
 
+/* max length of fanout_filter()/fanout_select() programs */
+#define FANOUT_FILTER_LEN	11
+
+/* fanout_key:
+ *	BPF instructions, that leave index of the sub-link, that is
+ *	to take the datagram, in A. Both the socket filter and the
+ *	SO_REUSEPORT selector run it, they see different headers at
+ *	offset 0, thus the network header is used only
+ * returns:
+ *	number of instructions			*/
+static int fanout_key(
+	link_data * link,
+	struct sock_filter * prog )
+{
+	int len = 0;
+
+	if(link->fanout_cpu) {
+		/* by CPU, processing the datagram: vypress chat
+		 * duplicates may go to different sub-links */
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+	} else {
+		/* by sender address & port: this keeps a sender (and
+		 * its vypress chat duplicates) on the same sub-link */
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_LDX | BPF_B | BPF_MSH, SKF_NET_OFF);
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_LD | BPF_H | BPF_IND,
+			SKF_NET_OFF + (int)offsetof(struct udphdr, source));
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_MISC | BPF_TAX, 0);
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_LD | BPF_W | BPF_ABS,
+			SKF_NET_OFF + (int)offsetof(struct iphdr, saddr));
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_ALU | BPF_ADD | BPF_X, 0);
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_ALU | BPF_MUL | BPF_K, 0x9e3779b1);
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_ALU | BPF_RSH | BPF_K, 16);
+	}
+	prog[len++] = (struct sock_filter)BPF_STMT(
+		BPF_ALU | BPF_MOD | BPF_K, link->fanout_count);
+
+	return len;
+}
+
+/* fanout_filter:
+ *	BPF program prefix, that drops datagrams of the other
+ *	sub-links (and goes on with the next instruction otherwise):
+ *	the kernel hands a copy of every broadcast to each socket
+ *	on the port, SO_REUSEPORT spreads unicasts only
+ * returns:
+ *	number of instructions			*/
+static int fanout_filter(
+	link_data * link,
+	struct sock_filter * prog )
+{
+	int len = fanout_key(link, prog);
+
+	prog[len++] = (struct sock_filter)BPF_JUMP(
+		BPF_JMP | BPF_JEQ | BPF_K, link->fanout_index, 1, 0);
+	prog[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+	assert(len <= FANOUT_FILTER_LEN);
+	return len;
+}
+
+/* fanout_select:
+ *	makes SO_REUSEPORT hand unicasts to the sub-link, whose
+ *	fanout_filter() takes them (sockets of the group are numbered
+ *	in the order of bind(), as sub-links are)	*/
+static int fanout_select(link_data * link)
+{
+	struct sock_filter prog[FANOUT_FILTER_LEN];
+	struct sock_fprog fprog;
+	int len = fanout_key(link, prog);
+
+	prog[len++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+
+	fprog.len = len;
+	fprog.filter = prog;
+	return setsockopt(link->rx, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+		&fprog, sizeof(fprog))==0;
+}
+
+/* attach_filter:
+ *	(re)attaches socket filter of the link, accepting messages
+ *	in `accepted' list only (or everything, if NULL)	*/
+static int attach_filter(
+	link_data * link,
+	const enum qcs_msgid * accepted )
+{
+	struct sock_filter prog[FANOUT_FILTER_LEN + 2 * QCS_MSGFILTER_MAX + 2];
+	struct sock_fprog fprog;
+	int len = 0, msg_len, vy_len, dummy = 0;
+
+	if(link->fanout_count > 1) {
+		len = fanout_filter(link, prog);
+	}
+
+	if(accepted==NULL) {
+		if(len==0) {
+			/* nothing to filter */
+			return setsockopt(link->rx, SOL_SOCKET,
+				SO_DETACH_FILTER, &dummy, sizeof(dummy))==0
+				|| errno==ENOENT;
+		}
+		prog[len++] = (struct sock_filter)BPF_STMT(
+			BPF_RET | BPF_K, 0xffffffff);
+	} else {
+		/* the filter sees datagrams with their UDP header */
+		switch(link->mode) {
+		case QCS_PROTO_QCHAT:
+			msg_len = qcs__msgfilter_qchat(accepted,
+				sizeof(struct udphdr), prog + len,
+				QCS_MSGFILTER_MAX);
+			break;
+		case QCS_PROTO_VYPRESS:
+			msg_len = qcs__msgfilter_vypress(accepted,
+				sizeof(struct udphdr), prog + len,
+				QCS_MSGFILTER_MAX);
+			break;
+		case QCS_PROTO_AUTO:
+			/* vypress chat datagrams start with the 'X' of
+			 * their signature: go on to the filter of either */
+			vy_len = qcs__msgfilter_vypress(accepted,
+				sizeof(struct udphdr), prog + len + 2,
+				QCS_MSGFILTER_MAX);
+			msg_len = vy_len ? qcs__msgfilter_qchat(accepted,
+				sizeof(struct udphdr), prog + len + 2 + vy_len,
+				QCS_MSGFILTER_MAX): 0;
+			if(msg_len) {
+				prog[len] = (struct sock_filter)BPF_STMT(
+					BPF_LD | BPF_B | BPF_ABS,
+					sizeof(struct udphdr));
+				prog[len + 1] = (struct sock_filter)BPF_JUMP(
+					BPF_JMP | BPF_JEQ | BPF_K, 'X', 0, vy_len);
+				msg_len += vy_len + 2;
+			}
+			break;
+		default:
+			ERRRET(ENOSYS);
+		}
+		if(!msg_len) {
+			return 0;
+		}
+		len += msg_len;
+	}
+
+	fprog.len = len;
+	fprog.filter = prog;
+	return setsockopt(link->rx, SOL_SOCKET, SO_ATTACH_FILTER,
+		&fprog, sizeof(fprog))==0;
+}
+
 /* bind_link:
  *	binds sockets to specified port on spec interface	*/
 static int bind_link(
 	link_data * link,
 	unsigned short port )	/* port to bind to */
 {
+	const int on = 1;
 	struct sockaddr_in sa;
 
-	assert( link->tx>=0 && link->rx>=0 && link);
+	assert( link && link->rx>=0 );
+
+	/* have receive time & destination of every datagram reported,
+	 * along with the number of datagrams the kernel dropped */
+	if(setsockopt(link->rx, SOL_SOCKET, SO_TIMESTAMPNS,
+		&on, sizeof(on)) != 0
+		|| setsockopt(link->rx, IPPROTO_IP, IP_PKTINFO,
+		&on, sizeof(on)) != 0
+		|| setsockopt(link->rx, SOL_SOCKET, SO_RXQ_OVFL,
+		&on, sizeof(on)) != 0)
+	{
+		return 0;
+	}
+
+	if(link->fanout_count > 1) {
+		/* share the port with the other sub-links */
+		if(setsockopt(link->rx, SOL_SOCKET, SO_REUSEPORT,
+			&on, sizeof(on)) != 0)
+		{
+			return 0;
+		}
+		if(link->fanout_cpu && setsockopt(link->rx, SOL_SOCKET,
+			SO_INCOMING_CPU, &link->fanout_index, sizeof(int)) != 0)
+		{
+			return 0;
+		}
+
+		/* take our share only, from the very first datagram */
+		if(!attach_filter(link, NULL)) {
+			return 0;
+		}
+		if(link->fanout_index==0 && !fanout_select(link)) {
+			return 0;
+		}
+	}
 
 	/* bind rx */
 	sa.sin_family = PF_INET;
@@ -122,39 +346,129 @@ static int bind_link(
 	return 1;
 }
 
-/** API implementation			*/
-qcs_link qcs_open(
-	int proto_mode,
-	const unsigned long * broadcasts,
-	unsigned short port )
+/* set_membership:
+ *	joins/leaves (optname: IP_ADD/DROP_MEMBERSHIP) multicast group
+ *	on the rx socket; group & ifaddr are in network byte order	*/
+static int set_membership(
+	link_data * link,
+	int optname,
+	unsigned long group,
+	unsigned long ifaddr )
 {
-	const int broadcast_on = 1;
-	link_data * link;
-	int errbak;
+	struct ip_mreq mreq;
 
-	/* check params */
-	if( proto_mode!=QCS_PROTO_VYPRESS && proto_mode!=QCS_PROTO_QCHAT ) {
-		ERRRET(ENOSYS);
-	}
+	mreq.imr_multiaddr.s_addr = group;
+	mreq.imr_interface.s_addr = ifaddr ? ifaddr: link->mcast_if;
+	return setsockopt(link->rx, IPPROTO_IP, optname,
+		&mreq, sizeof(mreq))==0;
+}
 
-	/* alloc link */
-	link = malloc(sizeof(link_data));
-	if(link==NULL) {
-		ERRRET(ENOMEM);
+/* setup_multicast:
+ *	sets TTL, loopback & interface of multicast sent by the link
+ *	and joins every multicast group on its broadcast list	*/
+static int setup_multicast(
+	link_data * link,
+	const qcs_link_opts * opts )
+{
+	const int loop = opts->mcast_loop ? 1: 0;
+	const int ttl = opts->mcast_ttl > 255 ? 255: opts->mcast_ttl;
+	struct in_addr ifaddr;
+	unsigned int i;
+
+	link->mcast_if = htonl(opts->mcast_if);
+
+	if(opts->mcast_ttl && setsockopt(link->tx, IPPROTO_IP,
+		IP_MULTICAST_TTL, &ttl, sizeof(ttl)) != 0)
+	{
+		return 0;
+	}
+	if(setsockopt(link->tx, IPPROTO_IP, IP_MULTICAST_LOOP,
+		&loop, sizeof(loop)) != 0)
+	{
+		return 0;
+	}
+	if(opts->mcast_if) {
+		ifaddr.s_addr = link->mcast_if;
+		if(setsockopt(link->tx, IPPROTO_IP, IP_MULTICAST_IF,
+			&ifaddr, sizeof(ifaddr)) != 0)
+		{
+			return 0;
+		}
 	}
 
-	/* setup broadcast list */
-	link->broadcasts = setup_bcast_list(broadcasts, &link->broadcast_count);
-	if(link->broadcasts == NULL) {
-		errbak = errno;
-		free(link);
-		ERRRET(errbak);
+	/* sub-links share the port, and get the datagrams of
+	 * the groups joined here (IP_MULTICAST_ALL) */
+	for(i = 0; i < link->broadcast_count; i++) {
+		if(IN_MULTICAST(ntohl(link->broadcasts[i]))
+			&& !set_membership(link, IP_ADD_MEMBERSHIP,
+				link->broadcasts[i], 0))
+		{
+			return 0;
+		}
 	}
+	return 1;
+}
+
+/* socket_recv, socket_send:
+ *	transport of links on UDP sockets	*/
+static int socket_recv(
+	link_data * link,
+	struct mmsghdr * hdrs,
+	unsigned int count,
+	int flags )
+{
+	return recvmmsg(link->rx, hdrs, count, flags, NULL);
+}
+
+static int socket_send(
+	link_data * link,
+	struct mmsghdr * hdrs,
+	unsigned int count )
+{
+	return sendmmsg(link->tx, hdrs, count, 0);
+}
+
+static const struct qcs__transport socket_transport = {
+	socket_recv, socket_send
+};
+
+/* segment_recv, segment_send:
+ *	transport of QCS_BACKEND_SEGMENT links	*/
+static int segment_recv(
+	link_data * link,
+	struct mmsghdr * hdrs,
+	unsigned int count,
+	int flags )
+{
+	return qcs__seg_recvmmsg(link->seg_host, hdrs, count, flags);
+}
+
+static int segment_send(
+	link_data * link,
+	struct mmsghdr * hdrs,
+	unsigned int count )
+{
+	return qcs__seg_sendmmsg(link->seg_host, hdrs, count);
+}
+
+static const struct qcs__transport segment_transport = {
+	segment_recv, segment_send
+};
+
+/* open_sockets:
+ *	opens tx & rx sockets of the link, bound to port	*/
+static int open_sockets(
+	link_data * link,
+	unsigned short port,
+	const qcs_link_opts * opts )
+{
+	const int broadcast_on = 1;
+
+	link->transport = &socket_transport;
 
 	/* alloc sockets */
 	link->tx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
 	if( link->tx < 0 ) {
-		free(link);
 		return 0;
 	}
 
@@ -162,249 +476,2297 @@ qcs_link qcs_open(
         if( setsockopt(link->tx, SOL_SOCKET, SO_BROADCAST,
                 (void*)&broadcast_on, sizeof(broadcast_on)) != 0 )
         {
-		errbak = errno;
-		close(link->tx);
-		free(link);
-		ERRRET(errbak);
+		return 0;
 	}
 
 	/* setup rx */
 	link->rx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-	if( link->rx < 1 ) {
-		errbak = errno;
-		close(link->tx);
-		free(link);
-		ERRRET(errbak);
-	}
-
-	if(!port) {
-		/* adjust port */
-		port = 8167;
+	if( link->rx < 0 ) {
+		return 0;
 	}
 
-	/* bind rx */
-	if( !bind_link(link, port)) {
-		errbak = errno;
-		close(link->rx);
-		close(link->tx);
-		free(link);
-		ERRRET(errbak);
-	}
+	/* bind rx, join multicast groups */
+	return bind_link(link, port) && setup_multicast(link, opts);
+}
 
-	/* set mode */
-	link->mode = proto_mode;
+/* open_segment:
+ *	attaches the link to an in-process segment, on port	*/
+static int open_segment(
+	link_data * link,
+	unsigned short port,
+	const qcs_link_opts * opts )
+{
+	link->transport = &segment_transport;
 
-	link_count ++;
+	link->seg_host = malloc(sizeof(struct qcs__seg_host));
+	if(link->seg_host==NULL) {
+		errno = ENOMEM;
+		return 0;
+	}
+	if(!qcs__seg_attach((struct qcs__segment *)opts->segment,
+		link->seg_host, port, QCS_SEGMENT_QUEUE, QCP_MAXUDPSIZE))
+	{
+		free(link->seg_host);
+		link->seg_host = NULL;
+		return 0;
+	}
 
-	/* return success */
-	return (qcs_link)link;
+	link->rx = link->seg_host->fd;
+	link->port = port;
+	return 1;
 }
 
-int qcs_close(qcs_link link_id)
+/* setup_rx_buffers:
+ *	allocates receive buffers for the link and
+ *	points mmsghdr's at their buffer slots		*/
+static int setup_rx_buffers(link_data * link)
 {
-	link_data * link = (link_data *)link_id;
+	int i;
 
-	/* check if link is valid */
-	if( !VALID_ID(link_id)) {
-		ERRRET(EINVAL);
-	}
+	link->rx_buf = malloc(QCS_RECV_BATCH * QCP_MAXUDPSIZE);
+	link->rx_hdrs = malloc(QCS_RECV_BATCH * sizeof(struct mmsghdr));
+	link->rx_iovs = malloc(QCS_RECV_BATCH * sizeof(struct iovec));
+	link->rx_addrs = malloc(QCS_RECV_BATCH * sizeof(struct sockaddr_in));
+	link->rx_ctrl = malloc(QCS_RECV_BATCH * RX_CTRL_SIZE);
 
-	if(!ACTIVE_LINK(link)) {
-		ERRRET(EINVAL);
+	if(!link->rx_buf || !link->rx_hdrs || !link->rx_iovs
+		|| !link->rx_addrs || !link->rx_ctrl)
+	{
+		/* (freed with the link) */
+		errno = ENOMEM;
+		return 0;
 	}
 
-	/* shutdown sockets */
-	close(link->rx);
-	close(link->tx);
-
-	/* delete broadcast ip list */
-	free(link->broadcasts);
-
-	/* delete link entry */
-	free(link);
+	memset(link->rx_hdrs, 0, QCS_RECV_BATCH * sizeof(struct mmsghdr));
+	for(i = 0; i < QCS_RECV_BATCH; i++) {
+		link->rx_iovs[i].iov_base = link->rx_buf + i * QCP_MAXUDPSIZE;
+		link->rx_iovs[i].iov_len = QCP_MAXUDPSIZE;
 
-	link_count--;
-	if( link_count==0 ) {
-		/* clean up duplicate buffer */
-		qcs__cleanup_dup();
+		link->rx_hdrs[i].msg_hdr.msg_iov = link->rx_iovs + i;
+		link->rx_hdrs[i].msg_hdr.msg_iovlen = 1;
+		link->rx_hdrs[i].msg_hdr.msg_name = link->rx_addrs + i;
+		link->rx_hdrs[i].msg_hdr.msg_control =
+			link->rx_ctrl + i * RX_CTRL_SIZE;
 	}
 
 	return 1;
 }
 
-int qcs_rxsocket(
-	qcs_link link_id,
-	int * p_rxsocket )
+static void free_rx_buffers(link_data * link)
 {
-	link_data * link = (link_data*)link_id;
+	free(link->rx_buf);
+	free(link->rx_hdrs);
+	free(link->rx_iovs);
+	free(link->rx_addrs);
+	free(link->rx_ctrl);
+}
 
-	if(!VALID_ID(link_id)) ERRRET(EINVAL);
-	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+/* reset_rx_hdrs:
+ *	resets address & control lengths of the first `count'
+ *	rx_hdrs: every receive overwrites them		*/
+static void reset_rx_hdrs(link_data * link, int count)
+{
+	int i;
 
-	*p_rxsocket = link->rx;
-	return 1;
+	for(i = 0; i < count; i++) {
+		link->rx_hdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		link->rx_hdrs[i].msg_hdr.msg_controllen = RX_CTRL_SIZE;
+	}
 }
 
-int qcs_waitinput(
-	qcs_link link_id,
-	int timeout_ms )
+/* get_rxinfo:
+ *	fills in receive info of the datagram from its header
+ *	(and picks up the kernel drop count, that came with it) */
+static void get_rxinfo(
+	link_data * link,
+	struct msghdr * hdr,
+	qcs_rxinfo * rx )
 {
-	link_data * link = (link_data *) link_id;
-	struct timeval tv;
-	fd_set fds;
-
-	// check if link is valid
-	if(!VALID_ID(link_id)) ERRRET(EINVAL);
-	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	struct cmsghdr * cmsg;
+	struct timespec ts;
+	struct in_pktinfo pktinfo;
+	struct sockaddr_in src;
+	uint32_t drops;
+
+	memset(rx, 0, sizeof(qcs_rxinfo));
+	if(hdr->msg_namelen >= sizeof(struct sockaddr_in)) {
+		memcpy(&src, hdr->msg_name, sizeof(src));
+		rx->src_ip = ntohl(src.sin_addr.s_addr);
+		rx->src_port = ntohs(src.sin_port);
+	}
 
-	// fill structs & select()
-	if(timeout_ms < 0) {
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-	} else {
-		tv.tv_sec = timeout_ms / 1000;
-		tv.tv_usec = (timeout_ms % 1000) * 1000;
+	for(cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+		if(cmsg->cmsg_level==SOL_SOCKET
+			&& cmsg->cmsg_type==SCM_TIMESTAMPNS)
+		{
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			rx->stamp_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		}
+		else if(cmsg->cmsg_level==IPPROTO_IP
+			&& cmsg->cmsg_type==IP_PKTINFO)
+		{
+			memcpy(&pktinfo, CMSG_DATA(cmsg), sizeof(pktinfo));
+			rx->dst_ip = ntohl(pktinfo.ipi_addr.s_addr);
+			rx->ifindex = pktinfo.ipi_ifindex;
+		}
+		else if(cmsg->cmsg_level==SOL_SOCKET
+			&& cmsg->cmsg_type==SO_RXQ_OVFL)
+		{
+			/* total for the socket, by the time
+			 * the datagram was queued */
+			memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+			__atomic_store_n(&link->stats.rx_kernel_drops, drops,
+				__ATOMIC_RELAXED);
+		}
 	}
+}
 
-	FD_ZERO(&fds);
-	FD_SET(link->rx, &fds);
+/* new_uring:
+ *	allocates & sets up io_uring	*/
+static struct qcs__uring * new_uring(
+	unsigned int entries,
+	unsigned int cq_entries )
+{
+	struct qcs__uring * ring;
+	int errbak;
 
-	return select(FD_SETSIZE, &fds, NULL, NULL, &tv);
+	ring = malloc(sizeof(struct qcs__uring));
+	if(ring==NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	if(!qcs__uring_init(ring, entries, cq_entries)) {
+		errbak = errno;
+		free(ring);
+		errno = errbak;
+		return NULL;
+	}
+	return ring;
 }
 
-int qcs_send(
-	qcs_link link_id,
-	const qcs_msg * msg )
+static void delete_uring(struct qcs__uring * ring)
 {
-	const char * proto_msg;
-	int proto_len, retval;
-	struct sockaddr_in sab;
-	link_data * link = (link_data *)link_id;
-	int bcast, succ = 0;
+	if(ring!=NULL) {
+		qcs__uring_free(ring);
+		free(ring);
+	}
+}
 
-	// check link
-	if(!VALID_ID(link_id)) ERRRET(EINVAL);
-	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+/* arm_rx_ring:
+ *	submits multishot recvmsg on the rx ring: it goes on delivering
+ *	datagrams into the ring buffers, till it runs out of them	*/
+static int arm_rx_ring(link_data * link)
+{
+	struct io_uring_sqe * sqe;
 
-	// build proto message
-	switch(link->mode) {
-	case QCS_PROTO_VYPRESS:
-		proto_msg = qcs__make_vypress_msg(msg, &proto_len);
-		break;
-	case QCS_PROTO_QCHAT:
-		proto_msg = qcs__make_qchat_msg(msg, &proto_len);
-		break;
+	sqe = qcs__uring_sqe(link->rx_ring);
+	if(sqe==NULL) {
+		ERRRET(EBUSY);
 	}
-	if( proto_msg==NULL ) {
-		// failed to build msg
-		ERRRET(EINVAL);
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = link->rx;
+	sqe->addr = (uintptr_t)link->rx_ring_msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+
+	if(!qcs__uring_submit(link->rx_ring, 0)) {
+		return 0;
 	}
+	link->rx_armed = 1;
+	return 1;
+}
 
-	sab.sin_family = PF_INET;
-	sab.sin_port = htons(link->port);
+/* setup_uring:
+ *	sets up io_uring backend of the link: rx ring, with recvmsg
+ *	armed, and tx ring (unless it is a sub-link)
+ * returns:
+ *	0, if the kernel can't do that: the link is left with no rings
+ */
+static int setup_uring(link_data * link)
+{
+	struct io_uring_cqe * cqe;
+	int errbak;
 
-	/* send msg to every network in bcast list */
-	for(bcast=0; bcast < link->broadcast_count; bcast++)
+	link->rx_ring = new_uring(4, QCS_URING_RX_BUFS * 2);
+	if(link->rx_ring==NULL || !qcs__uring_setup_bufs(link->rx_ring,
+		QCS_URING_RX_BUFS, RX_RING_BUF_SIZE))
 	{
-		sab.sin_addr.s_addr = link->broadcasts[bcast];
+		goto failed;
+	}
+	if(link->parent==NULL) {
+		link->tx_ring = new_uring(QCS_SEND_BATCH, 0);
+		if(link->tx_ring==NULL) {
+			goto failed;
+		}
+	}
 
-		retval = sendto(
-			link->tx, proto_msg, proto_len, 0,
-			(struct sockaddr*)&sab, sizeof(sab));
+	link->rx_ring_msg = calloc(1, sizeof(struct msghdr));
+	if(link->rx_ring_msg==NULL) {
+		errno = ENOMEM;
+		goto failed;
+	}
+	link->rx_ring_msg->msg_namelen = sizeof(struct sockaddr_in);
+	link->rx_ring_msg->msg_controllen = RX_CTRL_SIZE;
+	if(!arm_rx_ring(link)) {
+		goto failed;
+	}
 
-		/* we return success if we managed to 
-		 * send to at least one broadcast address */
-		succ |= retval==proto_len;
+	/* kernels without multishot recvmsg (6.0) fail it right away */
+	cqe = qcs__uring_cqe(link->rx_ring);
+	if(cqe!=NULL && cqe->res < 0) {
+		errno = -cqe->res;
+		goto failed;
 	}
-	free((void*)proto_msg);
+	return 1;
 
-	if(!succ) errno = ENETUNREACH;
-	return succ;
+failed:
+	errbak = errno;
+	delete_uring(link->rx_ring);
+	delete_uring(link->tx_ring);
+	free(link->rx_ring_msg);
+	link->rx_ring = link->tx_ring = NULL;
+	link->rx_ring_msg = NULL;
+	link->rx_armed = 0;
+	errno = errbak;
+	return 0;
 }
 
-int qcs_recv(
-	qcs_link link_id,
-	qcs_msg * msg )
+/* setup_rx:
+ *	sets up io_uring backend, if opts ask for it, or receive
+ *	buffers for plain sockets, if not (or the kernel can't)	*/
+static int setup_rx(
+	link_data * link,
+	const qcs_link_opts * opts )
 {
-	link_data * link = (link_data *)link_id;
-	char * buff;
+	if(opts->backend==QCS_BACKEND_URING && setup_uring(link)) {
+		return 1;
+	}
+	return setup_rx_buffers(link);
+}
 
-	struct sockaddr_in sa;
-	socklen_t sa_len;
-	int retval;
+/* release_rx_bufs:
+ *	gives ring buffers of the datagrams received last
+ *	back to the kernel	*/
+static void release_rx_bufs(link_data * link)
+{
+	while(link->rx_held_count) {
+		qcs__uring_put_buf(link->rx_ring,
+			link->rx_held[--link->rx_held_count]);
+	}
+}
 
-	if(msg==NULL) ERRRET(EINVAL);
+/* recv_ring_datagram:
+ *	takes next datagram, that recvmsg has put into a buffer of the
+ *	rx ring (waiting for it, if `wait' and the rx socket is not
+ *	O_NONBLOCK) and points hdr at its address & control data;
+ *	the buffer is held till release_rx_bufs()
+ * returns:
+ *	datagram length, or <0 on error	*/
+static int recv_ring_datagram(
+	link_data * link, int wait,
+	char ** p_buff,
+	struct msghdr * hdr )
+{
+	struct io_uring_recvmsg_out * out;
+	struct io_uring_cqe * cqe;
+	unsigned int bid, flags;
+	int res;
+
+	for(;;) {
+		cqe = qcs__uring_cqe(link->rx_ring);
+		if(cqe==NULL) {
+			/* re-arm recvmsg, if it has stopped */
+			if(!link->rx_armed && !arm_rx_ring(link)) {
+				return -1;
+			}
+			if(!wait || (fcntl(link->rx, F_GETFL) & O_NONBLOCK)) {
+				errno = EAGAIN;
+				return -1;
+			}
+			if(!qcs__uring_submit(link->rx_ring, 1)) {
+				return -1;
+			}
+			continue;
+		}
 
-	if(!VALID_ID(link_id)) ERRRET(EINVAL);
-	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+		res = cqe->res;
+		flags = cqe->flags;
+		qcs__uring_cqe_seen(link->rx_ring);
 
-	buff = (char*) malloc(QCP_MAXUDPSIZE+0x10);
-	if(buff==NULL) ERRRET(ENOMEM);
+		if(!(flags & IORING_CQE_F_MORE)) {
+			link->rx_armed = 0;
+		}
+		if(!(flags & IORING_CQE_F_BUFFER)) {
+			/* ENOBUFS: recvmsg has stopped, leaving the rest
+			 * in the socket, till it is re-armed */
+			if(res < 0 && res!=-ENOBUFS) {
+				errno = -res;
+				return -1;
+			}
+			continue;
+		}
 
-	// recv the data
-	sa_len = sizeof(sa);
-	retval = recvfrom(
-		link->rx, (void*)buff, QCP_MAXUDPSIZE, 0,
-		(struct sockaddr*)&sa, &sa_len
-	);
-	
-	/* check if msg is too long for us to process:
-	 * just strip it down. we guess this was the last
-	 * ascii field, in proto msg, that was soo long.
-	 */
-	if(retval==QCP_MAXUDPSIZE) {
-		*(char*)(buff+QCP_MAXUDPSIZE-1)='\0';
+		bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		link->rx_held[link->rx_held_count++] = bid;
+		out = (struct io_uring_recvmsg_out *)
+			QCS__URING_BUF(link->rx_ring, bid);
+
+		memset(hdr, 0, sizeof(struct msghdr));
+		hdr->msg_name = out + 1;
+		hdr->msg_namelen = out->namelen < sizeof(struct sockaddr_in)
+			? out->namelen: sizeof(struct sockaddr_in);
+		hdr->msg_control = (char *)(out + 1) + sizeof(struct sockaddr_in);
+		hdr->msg_controllen = out->controllen;
+		*p_buff = (char *)hdr->msg_control + RX_CTRL_SIZE;
+
+		/* keep the ring fd telling of input to come */
+		if(!link->rx_armed) {
+			arm_rx_ring(link);
+		}
+		return out->payloadlen < QCP_MAXUDPSIZE
+			? out->payloadlen: QCP_MAXUDPSIZE;
 	}
+}
 
-	/* failure */
-	if(retval < 0) {
-		free(buff);
-		/* errno left from recvfrom() */
+/* setup_tx_vectors:
+ *	prepares broadcast destinations and sendmmsg() vectors
+ *	(this is to be called after broadcast list setup)	*/
+static int setup_tx_vectors(link_data * link)
+{
+	unsigned int i, per_msg;
+
+	/* make sure every broadcast of a single message (both of its
+	 * datagrams, on a QCS_PROTO_AUTO link) fits into one sendmmsg() */
+	per_msg = link->broadcast_count * (link->mode==QCS_PROTO_AUTO ? 2: 1);
+	link->tx_slots = per_msg > QCS_SEND_BATCH ? per_msg: QCS_SEND_BATCH;
+
+	link->tx_addrs = malloc(link->broadcast_count * sizeof(struct sockaddr_in));
+	link->tx_hdrs = malloc(link->tx_slots * sizeof(struct mmsghdr));
+	link->tx_iovs = malloc(link->tx_slots * sizeof(struct iovec));
+	link->tx_buf = malloc(link->tx_slots * QCP_MAXDGRAMSIZE);
+	link->tx_lens = malloc(link->tx_slots * sizeof(size_t));
+	link->tx_ids = malloc(link->tx_slots * sizeof(enum qcs_msgid));
+	link->tx_more = calloc(link->tx_slots, 1);
+
+	if(!link->tx_addrs || !link->tx_hdrs || !link->tx_iovs
+		|| !link->tx_buf || !link->tx_lens || !link->tx_ids
+		|| !link->tx_more)
+	{
+		/* the rest is released with the link */
+		errno = ENOMEM;
+		return 0;
+	}
+
+	for(i = 0; i < link->broadcast_count; i++) {
+		memset(link->tx_addrs + i, 0, sizeof(struct sockaddr_in));
+		link->tx_addrs[i].sin_family = PF_INET;
+		link->tx_addrs[i].sin_port = htons(link->port);
+		link->tx_addrs[i].sin_addr.s_addr = link->broadcasts[i];
+	}
+
+	memset(link->tx_hdrs, 0, link->tx_slots * sizeof(struct mmsghdr));
+	for(i = 0; i < link->tx_slots; i++) {
+		link->tx_hdrs[i].msg_hdr.msg_iov = link->tx_iovs + i;
+		link->tx_hdrs[i].msg_hdr.msg_iovlen = 1;
+		link->tx_hdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	}
+
+	return 1;
+}
+
+static void free_tx_vectors(link_data * link)
+{
+	free(link->tx_addrs);
+	free(link->tx_hdrs);
+	free(link->tx_iovs);
+	free(link->tx_buf);
+	free(link->tx_lens);
+	free(link->tx_ids);
+	free(link->tx_more);
+}
+
+/* setup_tx_queue:
+ *	sets up send queue, if opts ask for pacing
+ *	or a non-blocking tx socket	*/
+static int setup_tx_queue(
+	link_data * link,
+	const qcs_link_opts * opts )
+{
+	unsigned int burst;
+	int flags;
+
+	if(!opts->tx_rate && !opts->tx_nonblock) {
+		/* sends go right away */
+		return 1;
+	}
+
+	if(opts->tx_nonblock && link->tx >= 0) {
+		/* (segment links never block) */
+		flags = fcntl(link->tx, F_GETFL);
+		if(flags < 0 || fcntl(link->tx, F_SETFL, flags | O_NONBLOCK) < 0) {
+			return 0;
+		}
+		link->tx_nonblock = 1;
+	}
+
+	link->txq_size = opts->tx_queue ? opts->tx_queue: QCS_TX_QUEUE;
+	if(link->mode==QCS_PROTO_AUTO && link->txq_size < 2) {
+		/* room for a message in both protocols */
+		link->txq_size = 2;
+	}
+	link->txq_buf = malloc(link->txq_size * QCP_MAXDGRAMSIZE);
+	link->txq_lens = malloc(link->txq_size * sizeof(size_t));
+	link->txq_ids = malloc(link->txq_size * sizeof(enum qcs_msgid));
+	link->txq_more = calloc(link->txq_size, 1);
+	if(!link->txq_buf || !link->txq_lens || !link->txq_ids
+		|| !link->txq_more)
+	{
+		/* released with the link */
+		errno = ENOMEM;
+		return 0;
+	}
+
+	if(!opts->tx_rate) {
+		/* unpaced */
+		return 1;
+	}
+
+	burst = opts->tx_burst ? opts->tx_burst: QCS_TX_BURST;
+	link->tx_interval = 1000000000ULL / opts->tx_rate;
+	if(!link->tx_interval) {
+		link->tx_interval = 1;
+	}
+	link->tx_tolerance = (burst - 1) * link->tx_interval;
+
+	link->tx_timer = timerfd_create(CLOCK_MONOTONIC,
+		TFD_NONBLOCK | TFD_CLOEXEC);
+	return link->tx_timer >= 0;
+}
+
+static void free_tx_queue(link_data * link)
+{
+	if(link->tx_timer >= 0) close(link->tx_timer);
+
+	free(link->txq_buf);
+	free(link->txq_lens);
+	free(link->txq_ids);
+	free(link->txq_more);
+}
+
+/* flush_tx_ring:
+ *	flush_tx_vectors() of an io_uring link: the entries go as
+ *	a chain of linked sendmsg's, that fails from the first entry
+ *	failing on (as sendmmsg() stops there); the entries after it
+ *	go with the next chain	*/
+static unsigned int flush_tx_ring(
+	link_data * link,
+	unsigned int count )
+{
+	struct io_uring_sqe * sqe, * last = NULL;
+	struct io_uring_cqe * cqe;
+	unsigned int sent = 0, n, got, index, failed;
+	int res, failed_res = 0;
+
+	while(sent < count) {
+		link->tx_chain ++;
+		for(n = 0; sent + n < count; n++) {
+			sqe = qcs__uring_sqe(link->tx_ring);
+			if(sqe==NULL) {
+				/* the rest goes with the next chain */
+				break;
+			}
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = link->tx;
+			sqe->addr = (uintptr_t)&link->tx_hdrs[sent + n].msg_hdr;
+			sqe->len = 1;
+			sqe->msg_flags = link->tx_nonblock ? MSG_DONTWAIT: 0;
+			sqe->flags = IOSQE_IO_LINK;
+			sqe->user_data = (uint64_t)link->tx_chain << 32 | (sent + n);
+			last = sqe;
+		}
+		if(n==0) {
+			/* no room in the submission ring */
+			break;
+		}
+		last->flags = 0;
+
+		if(!qcs__uring_submit(link->tx_ring, n)) {
+			/* skip the datagram, as sendmmsg() failure is */
+			link->tx_hdrs[sent].msg_len = 0;
+			sent ++;
+			continue;
+		}
+
+		/* collect cqes of the chain (those of chains, that
+		 * failed to complete, are left over) */
+		failed = count;
+		for(got = 0; got < n; ) {
+			cqe = qcs__uring_cqe(link->tx_ring);
+			if(cqe==NULL) {
+				if(!qcs__uring_submit(link->tx_ring, 1)) {
+					break;
+				}
+				continue;
+			}
+			if((unsigned int)(cqe->user_data >> 32)==link->tx_chain) {
+				index = (unsigned int)cqe->user_data;
+				res = cqe->res;
+				if(res >= 0) {
+					link->tx_hdrs[index].msg_len = res;
+				} else if(index < failed) {
+					failed = index;
+					failed_res = res;
+				}
+				got ++;
+			}
+			qcs__uring_cqe_seen(link->tx_ring);
+		}
+
+		if(failed==count) {
+			/* all went (or will never be known to) */
+			sent += n;
+		} else if(failed_res==-EAGAIN) {
+			/* the rest is to wait for POLLOUT */
+			sent = failed;
+			break;
+		} else {
+			/* skip the datagram that has failed and
+			 * try the rest of destinations */
+			link->tx_hdrs[failed].msg_len = 0;
+			sent = failed + 1;
+		}
+	}
+	return sent;
+}
+
+/* flush_tx_vectors:
+ *	sends first `count' datagrams set up in link->tx_hdrs;
+ *	msg_len of every entry that failed to go is left at 0
+ * returns:
+ *	number of entries done with: less than count, only if
+ *	the (non-blocking) tx socket buffer has filled up	*/
+static unsigned int flush_tx_vectors(
+	link_data * link,
+	unsigned int count )
+{
+	unsigned int sent = 0;
+	int retval;
+
+	if(link->tx_ring) {
+		return flush_tx_ring(link, count);
+	}
+
+	while(sent < count) {
+		retval = link->transport->send(link, link->tx_hdrs + sent,
+			count - sent);
+		if(retval < 0 && (errno==EAGAIN || errno==EWOULDBLOCK)) {
+			/* the rest is to wait for POLLOUT */
+			break;
+		}
+		if(retval <= 0) {
+			/* skip the datagram that has failed and
+			 * try the rest of destinations */
+			link->tx_hdrs[sent].msg_len = 0;
+			sent ++;
+		} else {
+			sent += retval;
+		}
+	}
+	return sent;
+}
+
+static unsigned long long monotonic_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* drain_tx_queue:
+ *	sends as much of the send queue, as the tx socket takes and
+ *	the token bucket of a paced link allows now; arms the timer
+ *	of a paced link for the rest	*/
+static void drain_tx_queue(link_data * link)
+{
+	unsigned long long now = 0, allowed, wake = 0;
+	unsigned int pairs, done, p, slot, bcast, left;
+	struct itimerspec its;
+
+	if(link->tx_interval) {
+		now = monotonic_ns();
+		if(link->tx_due < now) {
+			/* the bucket is full: don't save up past it */
+			link->tx_due = now;
+		}
+	}
+
+	link->tx_blocked = 0;
+	while(link->txq_count) {
+		allowed = link->tx_slots;
+		if(link->tx_interval) {
+			if(link->tx_due > now + link->tx_tolerance) {
+				break;
+			}
+			allowed = (now + link->tx_tolerance - link->tx_due)
+				/ link->tx_interval + 1;
+			if(allowed > link->tx_slots) {
+				allowed = link->tx_slots;
+			}
+		}
+
+		/* (datagram x broadcast address) pairs, from
+		 * where the head of the queue stopped on */
+		slot = link->txq_head;
+		bcast = link->txq_bcast;
+		left = link->txq_count;
+		for(pairs = 0; pairs < allowed && left; pairs++) {
+			link->tx_iovs[pairs].iov_base =
+				link->txq_buf + slot * QCP_MAXDGRAMSIZE;
+			link->tx_iovs[pairs].iov_len = link->txq_lens[slot];
+			link->tx_hdrs[pairs].msg_hdr.msg_name = link->tx_addrs + bcast;
+			link->tx_hdrs[pairs].msg_len = 0;
+
+			if(++bcast==link->broadcast_count) {
+				bcast = 0;
+				slot = (slot + 1) % link->txq_size;
+				left --;
+			}
+		}
+
+		done = flush_tx_vectors(link, pairs);
+		link->tx_due += done * link->tx_interval;
+
+		/* pop the messages, that went to every address */
+		for(p = 0; p < done; p++) {
+			if(link->tx_hdrs[p].msg_len==link->tx_iovs[p].iov_len) {
+				QCS_COUNT(link->stats.tx_datagrams, 1);
+				QCS_COUNT(link->stats.tx_bytes,
+					link->tx_iovs[p].iov_len);
+				link->txq_sent = 1;
+			} else {
+				QCS_COUNT(link->stats.tx_errors, 1);
+			}
+
+			if(++link->txq_bcast==link->broadcast_count) {
+				if(!link->txq_more[link->txq_head]) {
+					if(link->txq_sent) {
+						QCS_COUNT(link->stats.tx_msgs[
+							link->txq_ids[link->txq_head]], 1);
+					}
+					link->txq_sent = 0;
+				}
+				link->txq_bcast = 0;
+				link->txq_head = (link->txq_head + 1) % link->txq_size;
+				link->txq_count --;
+			}
+		}
+
+		if(done < pairs) {
+			/* tx socket buffer full */
+			link->tx_blocked = 1;
+			break;
+		}
+	}
+
+	if(!link->tx_interval) {
+		return;
+	}
+
+	/* wake up, when the next datagram is due
+	 * (when the tx socket is writable again, if it is full) */
+	if(link->txq_count && !link->tx_blocked) {
+		wake = link->tx_due - link->tx_tolerance;
+	}
+	if(wake!=link->tx_armed) {
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = wake / 1000000000ULL;
+		its.it_value.tv_nsec = wake % 1000000000ULL;
+		timerfd_settime(link->tx_timer, TFD_TIMER_ABSTIME, &its, NULL);
+		link->tx_armed = wake;
+	}
+}
+
+/* PEER_SLOT:
+ *	peer table entry of nickname hash	*/
+#define PEER_SLOT(hash)	(((hash) >> 1) & (QCS_PEER_TABLE - 1))
+
+/* peer_hash:
+ *	case-insensitive hash of nickname, with its low bit clear
+ *	(for the protocol) and never 0 (empty table entry)	*/
+static unsigned int peer_hash(const char * nick, int len)
+{
+	unsigned int hash = 2166136261U;
+	int i;
+
+	for(i = 0; i < len; i++) {
+		hash = (hash ^ (unsigned char)tolower((unsigned char)nick[i]))
+			* 16777619U;
+	}
+	hash &= ~1U;
+	return hash ? hash: 2;
+}
+
+/* remember_peer:
+ *	records protocol of the user, that sent view, in the peer table
+ *	of the link (shared with the sub-links: racing writers just
+ *	overwrite each other's single word entries)	*/
+static void remember_peer(
+	link_data * link,
+	const qcs_msg_view * view,
+	int proto )
+{
+	unsigned int * peers = link->parent ? link->parent->peers: link->peers;
+	unsigned int entry, slot;
+
+	if(peers==NULL || view->src.len==0) {
+		return;
+	}
+
+	/* QCS_PROTO_QCHAT/VYPRESS are 0/1, they fit in the low bit */
+	entry = peer_hash(view->src.str, view->src.len) | proto;
+	slot = PEER_SLOT(entry);
+	if(__atomic_load_n(peers + slot, __ATOMIC_RELAXED)!=entry) {
+		__atomic_store_n(peers + slot, entry, __ATOMIC_RELAXED);
+	}
+
+	/* the user goes on under the new nickname */
+	if(view->msg==QCS_MSG_RENAME && view->text.len) {
+		entry = peer_hash(view->text.str, view->text.len) | proto;
+		__atomic_store_n(peers + PEER_SLOT(entry), entry,
+			__ATOMIC_RELAXED);
+	}
+}
+
+/* tx_protos:
+ *	fills in protocols, that msg is to be sent in: that of the link,
+ *	or, on a QCS_PROTO_AUTO link, that of the user msg is for, if
+ *	known, both of them otherwise
+ * returns:
+ *	number of protocols	*/
+static int tx_protos(
+	link_data * link,
+	const qcs_msg_view * msg,
+	int * protos )
+{
+	unsigned int hash, entry;
+
+	if(link->mode!=QCS_PROTO_AUTO) {
+		protos[0] = link->mode;
+		return 1;
+	}
+
+	if(msg->dst.str!=NULL && msg->dst.len) {
+		hash = peer_hash(msg->dst.str, msg->dst.len);
+		entry = __atomic_load_n(link->peers + PEER_SLOT(hash),
+			__ATOMIC_RELAXED);
+		if((entry & ~1U)==hash) {
+			protos[0] = entry & 1U;
+			return 1;
+		}
+	}
+
+	protos[0] = QCS_PROTO_QCHAT;
+	protos[1] = QCS_PROTO_VYPRESS;
+	return 2;
+}
+
+/* encode_datagram:
+ *	builds datagram of protocol `proto' from msg into buf	*/
+static int encode_datagram(
+	link_data * link,
+	int proto,
+	const qcs_msg_view * msg,
+	char * buf, size_t cap,
+	size_t * p_len )
+{
+	switch(proto) {
+	case QCS_PROTO_VYPRESS:
+		return qcs__encode_vypress(msg, buf, cap, p_len,
+			&link->sig_seed);
+	case QCS_PROTO_QCHAT:
+		/* qchat has no signature: keep it in QCP_MAXUDPSIZE */
+		return qcs__encode_qchat(msg, buf,
+			cap < QCP_MAXUDPSIZE ? cap: QCP_MAXUDPSIZE, p_len);
+	}
+
+	errno = ENOSYS;
+	return 0;
+}
+
+/* parse_datagram:
+ *	parses datagram received on the link into view
+ *	(hdr - its header, with address & control data)	*/
+static int parse_datagram(
+	link_data * link,
+	char * buff, int len,
+	struct msghdr * hdr,
+	qcs_msg_view * view )
+{
+	qcs_rxinfo rx;
+	int retval, proto;
+
+	view->msg = QCS_MSG_INVALID;
+
+	/* first: the kernel drop count comes with datagrams,
+	 * that fail to parse, just as well */
+	get_rxinfo(link, hdr, &rx);
+
+	if(len <= 0) {
+		/* empty datagram */
+		errno = ENOMSG;
+		return 0;
+	}
+
+	/* check if msg is too long for us to process:
+	 * just strip it down. we guess this was the last
+	 * ascii field, in proto msg, that was soo long.
+	 */
+	if(len==QCP_MAXUDPSIZE) {
+		*(char*)(buff+QCP_MAXUDPSIZE-1)='\0';
+	}
+
+	proto = link->mode;
+	if(proto==QCS_PROTO_AUTO) {
+		/* vypress chat datagrams start with their signature */
+		proto = *buff=='X' ? QCS_PROTO_VYPRESS: QCS_PROTO_QCHAT;
+	}
+
+	switch(proto)
+	{
+	case QCS_PROTO_QCHAT:
+		retval = qcs__parse_qchat_view(buff, len, view, &link->filter);
+		break;
+	case QCS_PROTO_VYPRESS:
+		retval = qcs__parse_vypress_view(buff, len, view,
+			&link->dup, &link->filter);
+		break;
+	default:
+		ERRRET(ENOSYS);
+	}
+
+	QCS_COUNT(link->stats.rx_datagrams, 1);
+	QCS_COUNT(link->stats.rx_bytes, len);
+	if(!retval) {
+		QCS_COUNT(link->stats.rx_malformed, 1);
+		return 0;
+	}
+	if(view->msg!=QCS_MSG_INVALID) {
+		QCS_COUNT(link->stats.rx_msgs[view->msg], 1);
+	}
+
+	view->rx = rx;
+	view->rx.proto = proto;
+	if(link->mode==QCS_PROTO_AUTO && view->msg!=QCS_MSG_INVALID) {
+		remember_peer(link, view, proto);
+	}
+	return 1;
+}
+
+/* recv_datagram:
+ *	receives single datagram: into the first slot of rx_buf,
+ *	or a buffer of the rx ring, which *p_buff is pointed at
+ *	(and hdr at the header of the datagram)
+ * returns:
+ *	datagram length, or <0 on error	*/
+static int recv_datagram(
+	link_data * link,
+	char ** p_buff,
+	struct msghdr ** p_hdr,
+	struct msghdr * ring_hdr )
+{
+	int retval;
+
+	if(link->rx_ring) {
+		release_rx_bufs(link);
+		*p_hdr = ring_hdr;
+		return recv_ring_datagram(link, 1, p_buff, ring_hdr);
+	}
+
+	reset_rx_hdrs(link, 1);
+	*p_buff = link->rx_buf;
+	*p_hdr = &link->rx_hdrs[0].msg_hdr;
+	retval = link->transport->recv(link, link->rx_hdrs, 1, 0);
+	return retval < 0 ? retval: (int)link->rx_hdrs[0].msg_len;
+}
+
+/** API implementation			*/
+/* free_link:
+ *	releases whatever has been set up for the link	*/
+static void free_link(link_data * link)
+{
+	unsigned int i;
+
+	for(i = 0; link->subs!=NULL && i < link->fanout_count - 1; i++) {
+		if(link->subs[i]!=NULL) {
+			free_link(link->subs[i]);
+		}
+	}
+	free(link->subs);
+
+	delete_uring(link->rx_ring);
+	delete_uring(link->tx_ring);
+	free(link->rx_ring_msg);
+	if(link->seg_host!=NULL) {
+		/* rx is the eventfd of the segment host */
+		qcs__seg_detach(link->seg_host);
+		free(link->seg_host);
+		link->rx = -1;
+	}
+	if(link->rx >= 0) close(link->rx);
+	if(link->tx >= 0) close(link->tx);
+
+	free(link->broadcasts);
+	free(link->peers);
+	free_rx_buffers(link);
+	free_tx_vectors(link);
+	free_tx_queue(link);
+	qcs__dup_free(&link->dup);
+
+	free(link);
+}
+
+/* open_sublink:
+ *	opens sub-link `index' of the link (see qcs_sublink)	*/
+static link_data * open_sublink(
+	link_data * link,
+	unsigned int index,
+	const qcs_link_opts * opts )
+{
+	link_data * sub;
+	int errbak;
+
+	sub = calloc(1, sizeof(link_data));
+	if(sub==NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	sub->rx = sub->tx = sub->tx_timer = -1;
+	sub->transport = &socket_transport;
+
+	sub->mode = link->mode;
+	qcs__seed_signature(&sub->sig_seed, sub);
+	sub->parent = link;
+	sub->fanout_index = index;
+	sub->fanout_count = link->fanout_count;
+	sub->fanout_cpu = link->fanout_cpu;
+
+	sub->rx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(sub->rx < 0 || !bind_link(sub, link->port)
+		|| !setup_rx(sub, opts))
+	{
+		goto failed;
+	}
+
+	if( sub->mode!=QCS_PROTO_QCHAT
+		&& !qcs__dup_init(&sub->dup, opts->dup_cache_size
+			? opts->dup_cache_size: QCS_DUP_CACHE_SIZE))
+	{
+		goto failed;
+	}
+	return sub;
+
+failed:
+	errbak = errno;
+	free_link(sub);
+	errno = errbak;
+	return NULL;
+}
+
+void qcs_initopts(qcs_link_opts * opts)
+{
+	assert(opts);
+
+	memset(opts, 0, sizeof(qcs_link_opts));
+	opts->dup_cache_size = QCS_DUP_CACHE_SIZE;
+	opts->tx_burst = QCS_TX_BURST;
+	opts->tx_queue = QCS_TX_QUEUE;
+	opts->mcast_loop = 1;
+}
+
+qcs_link qcs_open(
+	int proto_mode,
+	const unsigned long * broadcasts,
+	unsigned short port )
+{
+	return qcs_open_ex(proto_mode, broadcasts, port, NULL);
+}
+
+qcs_link qcs_open_ex(
+	int proto_mode,
+	const unsigned long * broadcasts,
+	unsigned short port,
+	const qcs_link_opts * opts )
+{
+	qcs_link_opts def_opts;
+	link_data * link;
+	unsigned int i;
+	int errbak;
+
+	/* check params */
+	if( proto_mode!=QCS_PROTO_VYPRESS && proto_mode!=QCS_PROTO_QCHAT
+		&& proto_mode!=QCS_PROTO_AUTO )
+	{
+		ERRRET(ENOSYS);
+	}
+	if(opts==NULL) {
+		qcs_initopts(&def_opts);
+		opts = &def_opts;
+	}
+	if(opts->backend==QCS_BACKEND_SEGMENT && opts->segment==NULL) {
+		ERRRET(EINVAL);
+	}
+
+	/* alloc link: everything, that is not set up, is zero */
+	link = calloc(1, sizeof(link_data));
+	if(link==NULL) {
+		ERRRET(ENOMEM);
+	}
+	link->rx = link->tx = link->tx_timer = -1;
+
+	/* set mode */
+	link->mode = proto_mode;
+	qcs__seed_signature(&link->sig_seed, link);
+	link->fanout_count = opts->rx_fanout > 1
+		&& opts->backend!=QCS_BACKEND_SEGMENT ? opts->rx_fanout: 1;
+	link->fanout_cpu = opts->rx_fanout_cpu;
+
+	/* setup broadcast list */
+	link->broadcasts = setup_bcast_list(broadcasts, &link->broadcast_count);
+	if(link->broadcasts == NULL) {
+		goto failed;
+	}
+
+	if(!port) {
+		/* adjust port */
+		port = 8167;
+	}
+
+	/* open sockets, or attach to in-process segment */
+	if(opts->backend==QCS_BACKEND_SEGMENT
+		? !open_segment(link, port, opts)
+		: !open_sockets(link, port, opts))
+	{
+		goto failed;
+	}
+
+	/* setup receive buffers (or io_uring), send vectors & queue */
+	if( !setup_rx(link, opts) || !setup_tx_vectors(link)
+		|| !setup_tx_queue(link, opts))
+	{
+		goto failed;
+	}
+
+	/* setup duplicate detection (& the peer table) */
+	if( proto_mode!=QCS_PROTO_QCHAT
+		&& !qcs__dup_init(&link->dup, opts->dup_cache_size
+			? opts->dup_cache_size: QCS_DUP_CACHE_SIZE))
+	{
+		goto failed;
+	}
+	if(proto_mode==QCS_PROTO_AUTO) {
+		link->peers = calloc(QCS_PEER_TABLE, sizeof(unsigned int));
+		if(link->peers==NULL) {
+			errno = ENOMEM;
+			goto failed;
+		}
+	}
+
+	/* open the other sub-links on the same port */
+	if(link->fanout_count > 1) {
+		link->subs = calloc(link->fanout_count - 1, sizeof(link_data *));
+		if(link->subs==NULL) {
+			errno = ENOMEM;
+			goto failed;
+		}
+		for(i = 1; i < link->fanout_count; i++) {
+			link->subs[i - 1] = open_sublink(link, i, opts);
+			if(link->subs[i - 1]==NULL) {
+				goto failed;
+			}
+		}
+	}
+
+	/* return success */
+	return (qcs_link)link;
+
+failed:
+	errbak = errno;
+	free_link(link);
+	ERRRET(errbak);
+}
+
+int qcs_close(qcs_link link_id)
+{
+	link_data * link = (link_data *)link_id;
+
+	/* check if link is valid */
+	if( !VALID_ID(link_id)) {
+		ERRRET(EINVAL);
+	}
+
+	if(!ACTIVE_LINK(link)) {
+		ERRRET(EINVAL);
+	}
+
+	/* sub-links go with their link */
+	if(link->parent!=NULL) {
+		ERRRET(EINVAL);
+	}
+
+	/* shutdown sockets, delete buffers & the link entry */
+	free_link(link);
+
+	return 1;
+}
+
+qcs_link qcs_sublink(
+	qcs_link link_id,
+	unsigned int index )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(link->parent!=NULL || index >= link->fanout_count) ERRRET(EINVAL);
+
+	return index==0 ? link_id: (qcs_link)link->subs[index - 1];
+}
+
+int qcs_rxsocket(
+	qcs_link link_id,
+	int * p_rxsocket )
+{
+	link_data * link = (link_data*)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	*p_rxsocket = link->rx;
+	return 1;
+}
+
+int qcs_rxpollfd(
+	qcs_link link_id,
+	int * p_fd )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(p_fd==NULL) ERRRET(EINVAL);
+
+	*p_fd = RX_POLLFD(link);
+	return 1;
+}
+
+int qcs_backend(
+	qcs_link link_id,
+	int * p_backend )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(p_backend==NULL) ERRRET(EINVAL);
+
+	*p_backend = link->seg_host ? QCS_BACKEND_SEGMENT
+		: link->rx_ring ? QCS_BACKEND_URING: QCS_BACKEND_SOCKETS;
+	return 1;
+}
+
+int qcs_waitinput(
+	qcs_link link_id,
+	int timeout_ms )
+{
+	link_data * link = (link_data *) link_id;
+	struct pollfd pfd;
+
+	// check if link is valid
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	// fill structs & poll(): no FD_SETSIZE limit on rx socket
+	pfd.fd = RX_POLLFD(link);
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	return poll(&pfd, 1, timeout_ms < 0 ? 0: timeout_ms);
+}
+
+/* set_rx_nonblock:
+ *	switches O_NONBLOCK of link rx socket on/off
+ *	(an io_uring link follows it, when its ring is empty) */
+static int set_rx_nonblock(link_data * link, int on)
+{
+	int flags;
+
+
+	flags = fcntl(link->rx, F_GETFL);
+	if(flags < 0) {
+		return 0;
+	}
+	flags = on ? (flags | O_NONBLOCK): (flags & ~O_NONBLOCK);
+
+	return fcntl(link->rx, F_SETFL, flags)==0;
+}
+
+qcs_segment qcs_newsegment()
+{
+	struct qcs__segment * seg;
+
+	seg = malloc(sizeof(struct qcs__segment));
+	if(seg==NULL) {
+		ERRRET(ENOMEM);
+	}
+	qcs__seg_init(seg);
+	return (qcs_segment)seg;
+}
+
+void qcs_deletesegment(qcs_segment seg_id)
+{
+	struct qcs__segment * seg = (struct qcs__segment *)seg_id;
+
+	/* the links on it are closed already */
+	assert(seg==NULL || seg->hosts==NULL);
+	free(seg);
+}
+
+qcs_linkset qcs_newlinkset()
+{
+	linkset_data * set;
+	int errbak;
+
+	set = malloc(sizeof(linkset_data));
+	if(set==NULL) {
+		ERRRET(ENOMEM);
+	}
+
+	set->events = malloc(QCS_LINKSET_EVENTS * sizeof(struct epoll_event));
+	if(set->events==NULL) {
+		free(set);
+		ERRRET(ENOMEM);
+	}
+
+	set->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(set->epfd < 0) {
+		errbak = errno;
+		free(set->events);
+		free(set);
+		ERRRET(errbak);
+	}
+
+	return (qcs_linkset)set;
+}
+
+void qcs_deletelinkset(qcs_linkset set_id)
+{
+	linkset_data * set = (linkset_data *)set_id;
+
+	if(set) {
+		close(set->epfd);
+		free(set->events);
+		free(set);
+	}
+}
+
+int qcs_linkset_add(
+	qcs_linkset set_id,
+	qcs_link link_id )
+{
+	linkset_data * set = (linkset_data *)set_id;
+	link_data * link = (link_data *)link_id;
+	struct epoll_event ev;
+	int errbak;
+
+	if(!VALID_ID(set_id) || !VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	/* edge-triggered: link is reported once per arrival
+	 * and must be drained until EAGAIN */
+	if(!set_rx_nonblock(link, 1)) {
+		return 0;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = link;
+
+	if(epoll_ctl(set->epfd, EPOLL_CTL_ADD, RX_POLLFD(link), &ev) < 0) {
+		errbak = errno;
+		if(errbak!=EEXIST) {
+			set_rx_nonblock(link, 0);
+		}
+		ERRRET(errbak);
+	}
+
+	/* send timer of a paced link and tx socket of a non-blocking
+	 * one (edge-triggered: when it gets writable again) */
+	ev.data.u64 = (uintptr_t)link | LINKSET_FLUSH;
+	if(link->tx_timer >= 0) {
+		ev.events = EPOLLIN;
+		if(epoll_ctl(set->epfd, EPOLL_CTL_ADD, link->tx_timer, &ev) < 0) {
+			goto failed;
+		}
+	}
+	if(link->tx_nonblock) {
+		ev.events = EPOLLOUT | EPOLLET;
+		if(epoll_ctl(set->epfd, EPOLL_CTL_ADD, link->tx, &ev) < 0) {
+			goto failed;
+		}
+	}
+	return 1;
+
+failed:
+	errbak = errno;
+	qcs_linkset_remove(set_id, link_id);
+	ERRRET(errbak);
+}
+
+int qcs_linkset_remove(
+	qcs_linkset set_id,
+	qcs_link link_id )
+{
+	linkset_data * set = (linkset_data *)set_id;
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(set_id) || !VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	if(epoll_ctl(set->epfd, EPOLL_CTL_DEL, RX_POLLFD(link), NULL) < 0) {
+		/* errno left from epoll_ctl() */
+		return 0;
+	}
+	if(link->tx_timer >= 0) {
+		epoll_ctl(set->epfd, EPOLL_CTL_DEL, link->tx_timer, NULL);
+	}
+	if(link->tx_nonblock) {
+		epoll_ctl(set->epfd, EPOLL_CTL_DEL, link->tx, NULL);
+	}
+
+	/* back to blocking mode, as after qcs_open() */
+	return set_rx_nonblock(link, 0);
+}
+
+int qcs_linkset_wait(
+	qcs_linkset set_id,
+	qcs_link * ready,
+	int max_ready,
+	int timeout_ms )
+{
+	linkset_data * set = (linkset_data *)set_id;
+	unsigned long long deadline = 0, now;
+	uint64_t data;
+	int i, n, count;
+
+	if(!VALID_ID(set_id) || ready==NULL || max_ready <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if(timeout_ms > 0) {
+		deadline = monotonic_ns() + timeout_ms * 1000000ULL;
+	}
+
+	do {
+		n = epoll_wait(set->epfd, set->events,
+			max_ready < QCS_LINKSET_EVENTS ? max_ready: QCS_LINKSET_EVENTS,
+			timeout_ms);
+
+		for(i = count = 0; i < n; i++) {
+			data = set->events[i].data.u64;
+			if(data & LINKSET_FLUSH) {
+				/* link may send more of its queue */
+				qcs_flush((qcs_link)(uintptr_t)(data & ~LINKSET_FLUSH));
+			} else {
+				ready[count++] = (qcs_link)set->events[i].data.ptr;
+			}
+		}
+		if(n <= 0 || count) {
+			break;
+		}
+
+		/* only queues were served: wait for the rest of timeout */
+		if(timeout_ms > 0) {
+			now = monotonic_ns();
+			if(now >= deadline) {
+				break;
+			}
+			timeout_ms = (deadline - now + 999999) / 1000000;
+		}
+	} while(timeout_ms);
+
+	return n < 0 ? n: count;
+}
+
+int qcs_linkset_fd(
+	qcs_linkset set_id,
+	int * p_fd )
+{
+	linkset_data * set = (linkset_data *)set_id;
+
+	if(!VALID_ID(set_id) || p_fd==NULL) ERRRET(EINVAL);
+
+	*p_fd = set->epfd;
+	return 1;
+}
+
+int qcs_send(
+	qcs_link link_id,
+	const qcs_msg * msg )
+{
+	int sent;
+
+	if(msg==NULL) ERRRET(EINVAL);
+
+	sent = qcs_send_batch(link_id, &msg, 1);
+	if(sent==0 && (errno==ENOMSG || errno==EMSGSIZE)) {
+		// failed to build msg
+		errno = EINVAL;
+	}
+	return sent;
+}
+
+/* prepared_data:
+ *	message of qcs_newprepared(): its datagram per protocol of the
+ *	link, with the fields to fill in per send left as slots */
+typedef struct prepared_data_struct {
+	link_data * link;
+	enum qcs_msgid msg;
+	unsigned int mask;		/* QCS_SLOT_* */
+	qcs_msg_view route;		/* dst, if not a slot, for tx_protos() */
+	struct prepared_tmpl {
+		size_t len;		/* 0 - msg is not in the protocol */
+		int n_slots;
+		struct qcs__slot slots[QCS_PREPARED_SLOTS];
+		char buf[QCP_MAXDGRAMSIZE];
+	} tmpls[2];			/* by QCS_PROTO_QCHAT/VYPRESS */
+} prepared_data;
+
+/* batch_protos:
+ *	tx_protos() of a message of the batch: of the prepared
+ *	message prep, if its dst is not filled in per send */
+static int batch_protos(
+	link_data * link,
+	const prepared_data * prep,
+	const qcs_msg_view * msg,
+	int * protos )
+{
+	if(prep!=NULL && !(prep->mask & QCS_SLOT(QCS_DST))) {
+		msg = &prep->route;
+	}
+	return tx_protos(link, msg, protos);
+}
+
+/* build_datagram:
+ *	encode_datagram() of msg, or, if prep is not NULL, the datagram
+ *	of prep with its slots filled in from msg and a new signature */
+static int build_datagram(
+	link_data * link,
+	const prepared_data * prep,
+	int proto,
+	const qcs_msg_view * msg,
+	char * buf, size_t cap,
+	size_t * p_len )
+{
+	const struct prepared_tmpl * tmpl;
+
+	if(prep==NULL) {
+		return encode_datagram(link, proto, msg, buf, cap, p_len);
+	}
+
+	tmpl = prep->tmpls + proto;
+	if(tmpl->len==0) {
+		errno = ENOMSG;
+		return 0;
+	}
+	if(proto==QCS_PROTO_QCHAT && cap > QCP_MAXUDPSIZE) {
+		cap = QCP_MAXUDPSIZE;
+	}
+	if(!qcs__patch_msg(tmpl->buf, tmpl->len, tmpl->slots, tmpl->n_slots,
+		msg, buf, cap, p_len))
+	{
+		return 0;
+	}
+	if(proto==QCS_PROTO_VYPRESS) {
+		qcs__generate_signature(buf, &link->sig_seed);
+	}
+	return 1;
+}
+
+/* batch_view:
+ *	view of i-th message of the batch being sent: either of msgs
+ *	(pointed at its fields, in *tmp), or of views	*/
+static const qcs_msg_view * batch_view(
+	const qcs_msg * const * msgs,
+	const qcs_msg_view * views,
+	int i,
+	qcs_msg_view * tmp )
+{
+	if(msgs==NULL) {
+		return views + i;
+	}
+	qcs__viewmsg(msgs[i], tmp);
+	return tmp;
+}
+
+/* queue_batch:
+ *	send_batch() of a link with send queue: queues the
+ *	messages and sends what can go now	*/
+static int queue_batch(
+	link_data * link,
+	const prepared_data * prep,
+	const qcs_msg * const * msgs,
+	const qcs_msg_view * views,
+	int count )
+{
+	const qcs_msg_view * msg;
+	qcs_msg_view tmp;
+	unsigned int slot, last = 0, queued;
+	int i, p, n_protos, protos[2], succ = 0, errbak = 0;
+
+	for(i = 0; i < count; i++) {
+		msg = batch_view(msgs, views, i, &tmp);
+		n_protos = batch_protos(link, prep, msg, protos);
+		if(link->txq_size - link->txq_count < (unsigned int)n_protos) {
+			/* make room, if any is due */
+			drain_tx_queue(link);
+		}
+		if(link->txq_size - link->txq_count < (unsigned int)n_protos) {
+			QCS_COUNT(link->stats.tx_queue_drops, 1);
+			errbak = ENOBUFS;
+			continue;
+		}
+
+		/* a datagram per protocol, in consecutive slots */
+		queued = 0;
+		for(p = 0; p < n_protos; p++) {
+			slot = (link->txq_head + link->txq_count) % link->txq_size;
+			if(!build_datagram(link, prep, protos[p], msg,
+				link->txq_buf + slot * QCP_MAXDGRAMSIZE,
+				QCP_MAXDGRAMSIZE, link->txq_lens + slot))
+			{
+				errbak = errno;
+				continue;
+			}
+			link->txq_ids[slot] = prep ? prep->msg: msg->msg;
+			link->txq_more[slot] = 1;
+			link->txq_count ++;
+			last = slot;
+			queued ++;
+		}
+		if(!queued) {
+			/* failed to build msg: skip it */
+			QCS_COUNT(link->stats.tx_invalid, 1);
+			continue;
+		}
+		link->txq_more[last] = 0;
+		succ ++;
+	}
+
+	drain_tx_queue(link);
+
+	if(!succ && count) errno = errbak;
+	return succ;
+}
+
+/* send_batch:
+ *	sends `count' messages of msgs, or views, if msgs is NULL
+ *	(views fill in the slots of prep, if it is not NULL) */
+static int send_batch(
+	link_data * link,
+	const prepared_data * prep,
+	const qcs_msg * const * msgs,
+	const qcs_msg_view * views,
+	int count )
+{
+	const qcs_msg_view * msg;
+	qcs_msg_view tmp;
+	unsigned int per_call, pairs, bcast, d, n, first;
+	int i, p, n_protos, protos[2], msg_succ, succ = 0, errbak = 0;
+	char * dgram;
+
+	if(link->txq_size) {
+		return queue_batch(link, prep, msgs, views, count);
+	}
+
+	/* number of datagrams that go in a single sendmmsg() */
+	per_call = link->tx_slots / link->broadcast_count;
+
+	for(i = 0; i < count; ) {
+		/* build up to per_call datagrams, each going
+		 * to every network in bcast list */
+		pairs = 0;
+		for(n = 0; i < count; i++) {
+			msg = batch_view(msgs, views, i, &tmp);
+			n_protos = batch_protos(link, prep, msg, protos);
+			if(n + n_protos > per_call) {
+				break;
+			}
+
+			/* a datagram per protocol */
+			first = n;
+			for(p = 0; p < n_protos; p++) {
+				dgram = link->tx_buf + n * QCP_MAXDGRAMSIZE;
+				if(!build_datagram(link, prep, protos[p], msg,
+					dgram, QCP_MAXDGRAMSIZE, link->tx_lens + n))
+				{
+					errbak = errno;
+					continue;
+				}
+				link->tx_ids[n] = prep ? prep->msg: msg->msg;
+				link->tx_more[n] = 1;
+
+				for(bcast = 0; bcast < link->broadcast_count; bcast++) {
+					link->tx_iovs[pairs].iov_base = dgram;
+					link->tx_iovs[pairs].iov_len = link->tx_lens[n];
+					link->tx_hdrs[pairs].msg_hdr.msg_name = link->tx_addrs + bcast;
+					link->tx_hdrs[pairs].msg_len = 0;
+					pairs ++;
+				}
+				n ++;
+			}
+			if(n==first) {
+				// failed to build msg: skip it
+				QCS_COUNT(link->stats.tx_invalid, 1);
+				continue;
+			}
+			link->tx_more[n - 1] = 0;
+		}
+
+		flush_tx_vectors(link, pairs);
+
+		/* we count a msg as sent if we managed to send
+		 * it to at least one broadcast address */
+		msg_succ = 0;
+		for(d = 0; d < n; d++) {
+			for(bcast = 0; bcast < link->broadcast_count; bcast++) {
+				pairs = d * link->broadcast_count + bcast;
+				if(link->tx_hdrs[pairs].msg_len
+					== link->tx_iovs[pairs].iov_len)
+				{
+					QCS_COUNT(link->stats.tx_datagrams, 1);
+					QCS_COUNT(link->stats.tx_bytes,
+						link->tx_iovs[pairs].iov_len);
+					msg_succ = 1;
+				} else {
+					QCS_COUNT(link->stats.tx_errors, 1);
+				}
+			}
+			if(link->tx_more[d]) {
+				/* the rest of the message follows */
+				continue;
+			}
+			if(msg_succ) {
+				QCS_COUNT(link->stats.tx_msgs[link->tx_ids[d]], 1);
+			}
+			succ += msg_succ;
+			msg_succ = 0;
+		}
+	}
+
+	if(!succ && count) errno = errbak ? errbak: ENETUNREACH;
+	return succ;
+}
+
+int qcs_send_batch(
+	qcs_link link_id,
+	const qcs_msg * const * msgs,
+	int count )
+{
+	link_data * link = (link_data *)link_id;
+
+	// check link
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(link->parent!=NULL) ERRRET(EINVAL);	/* sub-links don't send */
+	if(msgs==NULL || count < 0) ERRRET(EINVAL);
+
+	return send_batch(link, NULL, msgs, NULL, count);
+}
+
+int qcs_send_view(
+	qcs_link link_id,
+	const qcs_msg_view * view )
+{
+	int sent;
+
+	if(view==NULL) ERRRET(EINVAL);
+
+	sent = qcs_send_view_batch(link_id, view, 1);
+	if(sent==0 && (errno==ENOMSG || errno==EMSGSIZE)) {
+		// failed to build msg
+		errno = EINVAL;
+	}
+	return sent;
+}
+
+int qcs_send_view_batch(
+	qcs_link link_id,
+	const qcs_msg_view * views,
+	int count )
+{
+	link_data * link = (link_data *)link_id;
+
+	// check link
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(link->parent!=NULL) ERRRET(EINVAL);	/* sub-links don't send */
+	if(views==NULL || count < 0) ERRRET(EINVAL);
+
+	return send_batch(link, NULL, NULL, views, count);
+}
+
+qcs_prepared qcs_newprepared(
+	qcs_link link_id,
+	const qcs_msg * msg,
+	unsigned int slots )
+{
+	link_data * link = (link_data *)link_id;
+	prepared_data * prep;
+	struct prepared_tmpl * tmpl;
+	qcs_msg_view view;
+	int p, n_protos, protos[2], built = 0, errbak = 0;
+
+	// check link
+	if(!VALID_ID(link_id) || msg==NULL) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if(!ACTIVE_LINK(link) || link->parent!=NULL
+		|| (slots & ~QCS_SLOT_ALL))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	prep = calloc(1, sizeof(prepared_data));
+	if(prep==NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	prep->link = link;
+	prep->msg = msg->msg;
+	prep->mask = slots;
+
+	qcs__viewmsg(msg, &view);
+	if(!(slots & QCS_SLOT(QCS_DST)) && view.dst.str!=NULL) {
+		/* the peer it is for, on a QCS_PROTO_AUTO link */
+		prep->route.dst.str = strdup(msg->dst);
+		prep->route.dst.len = view.dst.len;
+		if(prep->route.dst.str==NULL) {
+			free(prep);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	/* a datagram per protocol, that the link may send msg in */
+	if(link->mode==QCS_PROTO_AUTO) {
+		protos[0] = QCS_PROTO_QCHAT;
+		protos[1] = QCS_PROTO_VYPRESS;
+		n_protos = 2;
+	} else {
+		protos[0] = link->mode;
+		n_protos = 1;
+	}
+	for(p = 0; p < n_protos; p++) {
+		tmpl = prep->tmpls + protos[p];
+		if(!(protos[p]==QCS_PROTO_VYPRESS
+			? qcs__prepare_vypress(&view, slots,
+				tmpl->slots, &tmpl->n_slots,
+				tmpl->buf, QCP_MAXDGRAMSIZE, &tmpl->len)
+			: qcs__prepare_qchat(&view, slots,
+				tmpl->slots, &tmpl->n_slots,
+				tmpl->buf, QCP_MAXUDPSIZE, &tmpl->len)))
+		{
+			errbak = errno;
+			tmpl->len = 0;
+			continue;
+		}
+		built ++;
+	}
+	if(!built) {
+		qcs_deleteprepared((qcs_prepared)prep);
+		/* failed to build msg */
+		errno = errbak==ENOMSG || errbak==EMSGSIZE ? EINVAL: errbak;
+		return NULL;
+	}
+
+	return (qcs_prepared)prep;
+}
+
+void qcs_deleteprepared(qcs_prepared prep_id)
+{
+	prepared_data * prep = (prepared_data *)prep_id;
+
+	if(!VALID_ID(prep_id)) {
+		return;
+	}
+	free((char *)prep->route.dst.str);
+	free(prep);
+}
+
+int qcs_send_prepared(
+	qcs_link link_id,
+	qcs_prepared prep_id,
+	const qcs_msg_view * fills,
+	int count )
+{
+	link_data * link = (link_data *)link_id;
+	prepared_data * prep = (prepared_data *)prep_id;
+
+	// check link
+	if(!VALID_ID(link_id) || !VALID_ID(prep_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(prep->link!=link) ERRRET(EINVAL);	/* prepared for another */
+	if(fills==NULL || count < 0) ERRRET(EINVAL);
+
+	return send_batch(link, prep, NULL, fills, count);
+}
+
+int qcs_mcast_join(
+	qcs_link link_id,
+	unsigned long group,
+	unsigned long ifaddr )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(link->parent!=NULL || !IN_MULTICAST(group)) ERRRET(EINVAL);
+	if(link->seg_host) {
+		/* every host on a segment gets the datagrams of its port */
+		return 1;
+	}
+
+	return set_membership(link, IP_ADD_MEMBERSHIP,
+		htonl(group), htonl(ifaddr));
+}
+
+int qcs_mcast_leave(
+	qcs_link link_id,
+	unsigned long group,
+	unsigned long ifaddr )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(link->parent!=NULL || !IN_MULTICAST(group)) ERRRET(EINVAL);
+	if(link->seg_host) {
+		/* every host on a segment gets the datagrams of its port */
+		return 1;
+	}
+
+	return set_membership(link, IP_DROP_MEMBERSHIP,
+		htonl(group), htonl(ifaddr));
+}
+
+int qcs_txsocket(
+	qcs_link link_id,
+	int * p_txsocket )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(p_txsocket==NULL) ERRRET(EINVAL);
+
+	*p_txsocket = link->tx;
+	return 1;
+}
+
+int qcs_txqueue(
+	qcs_link link_id,
+	unsigned int * p_queued,
+	int * p_blocked )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	if(p_queued) *p_queued = link->txq_count;
+	if(p_blocked) *p_blocked = link->tx_blocked;
+	return 1;
+}
+
+int qcs_txtimer(
+	qcs_link link_id,
+	int * p_timerfd )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(p_timerfd==NULL) ERRRET(EINVAL);
+
+	*p_timerfd = link->tx_timer;
+	return 1;
+}
+
+int qcs_flush(qcs_link link_id)
+{
+	link_data * link = (link_data *)link_id;
+	uint64_t expirations;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	if(!link->txq_size) {
+		/* nothing is ever queued */
+		return 1;
+	}
+
+	/* reset the timer, if it has gone off */
+	if(link->tx_interval) {
+		if(read(link->tx_timer, &expirations, sizeof(expirations)) > 0) {
+			link->tx_armed = 0;
+		} else if(errno!=EAGAIN) {
+			return 0;
+		}
+	}
+
+	drain_tx_queue(link);
+	return 1;
+}
+
+int qcs_encode(
+	qcs_link link_id,
+	const qcs_msg * msg,
+	char * buf,
+	size_t cap,
+	size_t * p_len )
+{
+	link_data * link = (link_data *)link_id;
+	qcs_msg_view view;
+	int protos[2];
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(!msg || !buf || !p_len) ERRRET(EINVAL);
+
+	qcs__viewmsg(msg, &view);
+	tx_protos(link, &view, protos);
+	return encode_datagram(link, protos[0], &view, buf, cap, p_len);
+}
+
+int qcs_recv(
+	qcs_link link_id,
+	qcs_msg * msg )
+{
+	qcs_msg_view view;
+
+	if(msg==NULL) ERRRET(EINVAL);
+
+	if(!qcs_recv_view(link_id, &view)) {
+		if(errno==ENOMSG) {
+			qcs__cleanupmsg(msg);
+		}
+		return 0;
+	}
+	return qcs__materialize(&view, msg);
+}
+
+int qcs_recv_view(
+	qcs_link link_id,
+	qcs_msg_view * view )
+{
+	link_data * link = (link_data *)link_id;
+	struct msghdr ring_hdr, * hdr;
+	char * buff;
+	int retval;
+
+	if(view==NULL) ERRRET(EINVAL);
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	// recv the data
+	retval = recv_datagram(link, &buff, &hdr, &ring_hdr);
+
+	/* failure */
+	if(retval < 0) {
+		/* errno left from recvfrom() */
 		return 0;
 	}
 
 	/* parse the message */
-	switch(link->mode)
-	{
+	return parse_datagram(link, buff, retval, hdr, view);
+}
+
+/* recv_ring_batch:
+ *	qcs_recv_batch() of an io_uring link: takes up to `max'
+ *	datagrams from the rx ring, waiting for the first one only */
+static int recv_ring_batch(
+	link_data * link,
+	qcs_msg ** msgs,
+	int max,
+	int * p_count )
+{
+	struct msghdr hdr;
+	qcs_msg_view view;
+	char * buff;
+	int i, len;
+
+	release_rx_bufs(link);
+
+	for(i = 0; i < max; i++) {
+		len = recv_ring_datagram(link, i==0, &buff, &hdr);
+		if(len < 0) {
+			if(i==0) {
+				/* errno left from recv_ring_datagram() */
+				return 0;
+			}
+			break;
+		}
+
+		if(parse_datagram(link, buff, len, &hdr, &view)
+			&& view.msg!=QCS_MSG_INVALID
+			&& qcs__materialize(&view, msgs[*p_count]))
+		{
+			(*p_count) ++;
+		}
+	}
+
+	return 1;
+}
+
+int qcs_recv_batch(
+	qcs_link link_id,
+	qcs_msg ** msgs,
+	int max,
+	int * p_count )
+{
+	link_data * link = (link_data *)link_id;
+	qcs_msg_view view;
+	int i, received;
+
+	if(msgs==NULL || p_count==NULL || max <= 0) ERRRET(EINVAL);
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	*p_count = 0;
+
+	if(max > QCS_RECV_BATCH) {
+		max = QCS_RECV_BATCH;
+	}
+
+	if(link->rx_ring) {
+		return recv_ring_batch(link, msgs, max, p_count);
+	}
+
+	reset_rx_hdrs(link, max);
+
+	/* block for the first datagram only, take
+	 * whatever else is queued up without waiting */
+	received = link->transport->recv(link, link->rx_hdrs, max,
+		MSG_WAITFORONE);
+	if(received < 0) {
+		/* errno left from recvmmsg() */
+		return 0;
+	}
+
+	/* parse datagrams into msgs[], skipping malformed ones
+	 * and vypress duplicates (which parse into QCS_MSG_INVALID) */
+	for(i = 0; i < received; i++) {
+		if(parse_datagram(link, link->rx_buf + i * QCP_MAXUDPSIZE,
+			link->rx_hdrs[i].msg_len, &link->rx_hdrs[i].msg_hdr, &view)
+			&& view.msg!=QCS_MSG_INVALID
+			&& qcs__materialize(&view, msgs[*p_count]))
+		{
+			(*p_count) ++;
+		}
+	}
+
+	return 1;
+}
+
+int qcs_peek(
+	int proto_mode,
+	const char * buf,
+	int len,
+	qcs_msg_peek * peek )
+{
+	if(buf==NULL || len < 0 || peek==NULL) ERRRET(EINVAL);
+
+	if(proto_mode==QCS_PROTO_AUTO) {
+		proto_mode = len && *buf=='X'
+			? QCS_PROTO_VYPRESS: QCS_PROTO_QCHAT;
+	}
+
+	switch(proto_mode) {
 	case QCS_PROTO_QCHAT:
-		retval = qcs__parse_qchat_msg(buff, retval, msg);
-		break;
+		return qcs__peek_qchat(buf, len, peek);
 	case QCS_PROTO_VYPRESS:
-		retval = qcs__parse_vypress_msg(buff, retval, msg);
-		break;
+		return qcs__peek_vypress(buf, len, peek);
+	}
+	ERRRET(ENOSYS);
+}
+
+int qcs_setrecvfilter(
+	qcs_link link_id,
+	qcs_recv_filter filter,
+	void * data )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	link->filter.fn = filter;
+	link->filter.data = data;
+	return 1;
+}
+
+int qcs_setmsgfilter(
+	qcs_link link_id,
+	const enum qcs_msgid * accepted )
+{
+	link_data * link = (link_data *)link_id;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(link->seg_host) ERRRET(EOPNOTSUPP);	/* no kernel to filter */
+
+	return attach_filter(link, accepted);
+}
+
+/* add_stats:
+ *	adds counters of a (sub-)link to stats	*/
+static void add_stats(const link_data * link, qcs_stats * stats)
+{
+#define ADD(field) \
+	stats->field += __atomic_load_n(&link->stats.field, __ATOMIC_RELAXED)
+	int i;
+
+	for(i = 0; i < QCS_MSG_COUNT; i++) {
+		ADD(rx_msgs[i]);
+		ADD(tx_msgs[i]);
 	}
+	ADD(rx_datagrams);
+	ADD(rx_bytes);
+	ADD(rx_malformed);
+	ADD(rx_kernel_drops);
+	ADD(tx_datagrams);
+	ADD(tx_bytes);
+	ADD(tx_errors);
+	ADD(tx_invalid);
+	ADD(tx_queue_drops);
+
+	stats->rx_duplicates += __atomic_load_n(&link->dup.hits, __ATOMIC_RELAXED);
+	stats->rx_filtered += __atomic_load_n(&link->filter.dropped, __ATOMIC_RELAXED);
+#undef ADD
+}
+
+int qcs_link_stats(
+	qcs_link link_id,
+	qcs_stats * stats )
+{
+	link_data * link = (link_data *)link_id;
+	unsigned int i;
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+	if(stats==NULL) ERRRET(EINVAL);
 
-	/* cleanup */
-	free((void*)buff);
-	return retval;
+	memset(stats, 0, sizeof(qcs_stats));
+	add_stats(link, stats);
+	for(i = 0; link->parent==NULL && i < link->fanout_count - 1; i++) {
+		add_stats(link->subs[i], stats);
+	}
+	return 1;
 }
 
 qcs_msg * qcs_newmsg()
 {
-	qcs_msg * msg = malloc( sizeof(qcs_msg));
-	if( msg==NULL ) {
-		// out of memory
-		return NULL;
+	return qcs__allocmsg();
+}
+
+void qcs_deletemsg( qcs_msg * msg )
+{
+	if(msg==NULL) return;
+
+	qcs__freemsg(msg);
+}
+
+qcs_msgpool qcs_newmsgpool(unsigned int prealloc)
+{
+	msgpool_data * pool;
+	qcs_msg * msg;
+
+	pool = malloc(sizeof(msgpool_data));
+	if(pool==NULL) {
+		ERRRET(ENOMEM);
 	}
+	pool->free = NULL;
 
-	msg->msg = QCS_MSG_INVALID;
-	msg->mode = QCS_UMODE_INVALID;
-	msg->src = msg->dst = msg->text = msg->supp = msg->chan = NULL;
+	while(prealloc--) {
+		msg = qcs__allocmsg();
+		if(msg==NULL) {
+			qcs_deletemsgpool((qcs_msgpool)pool);
+			ERRRET(ENOMEM);
+		}
+		msg->store->next = pool->free;
+		pool->free = msg;
+	}
+
+	return (qcs_msgpool)pool;
+}
+
+void qcs_deletemsgpool(qcs_msgpool pool_id)
+{
+	msgpool_data * pool = (msgpool_data *)pool_id;
+	qcs_msg * msg;
+
+	if(pool==NULL) return;
+
+	while(pool->free) {
+		msg = pool->free;
+		pool->free = msg->store->next;
+		qcs__freemsg(msg);
+	}
+	free(pool);
+}
+
+qcs_msg * qcs_acquiremsg(qcs_msgpool pool_id)
+{
+	msgpool_data * pool = (msgpool_data *)pool_id;
+	qcs_msg * msg;
+
+	assert(pool);
+
+	if(pool->free==NULL) {
+		/* pool is empty: grow it by this one */
+		return qcs__allocmsg();
+	}
+
+	msg = pool->free;
+	pool->free = msg->store->next;
+	msg->store->next = NULL;
 
 	return msg;
 }
 
-void qcs_deletemsg( qcs_msg * msg )
+void qcs_releasemsg(
+	qcs_msgpool pool_id,
+	qcs_msg * msg )
 {
+	msgpool_data * pool = (msgpool_data *)pool_id;
+
+	assert(pool);
+
 	if(msg==NULL) return;
+	assert(msg->store);
 
-	if( msg->src ) free( msg->src );
-	if( msg->dst ) free( msg->dst );
-	if( msg->text ) free( msg->text );
-	if( msg->supp ) free( msg->supp );
-	if( msg->chan ) free( msg->chan );
+	qcs__cleanupmsg(msg);
+	msg->mode = QCS_UMODE_INVALID;
 
-	free( msg );
+	msg->store->next = pool->free;
+	pool->free = msg;
 }
 
 int qcs_msgset(
@@ -412,57 +2774,32 @@ int qcs_msgset(
 	enum qcs_textid which,
 	const char * new_text )
 {
-	char ** ptext, * new_p;
-	int slen;
-
 	if(!msg) {
 		errno = EINVAL;
 		return 0;
 	}
 
 	switch(which) {
-	case QCS_SRC: ptext = &msg->src; break;
-	case QCS_DST: ptext = &msg->dst; break;
-	case QCS_TEXT: ptext = &msg->text; break;
-	case QCS_SUPP: ptext = &msg->supp; break;
-	case QCS_CHAN: ptext = &msg->chan; break;
+	case QCS_SRC: case QCS_DST: case QCS_TEXT:
+	case QCS_SUPP: case QCS_CHAN:
+		break;
 	default:
 		errno = EINVAL;
 		return 0;
 	}
 
-	if(*ptext==NULL && new_text==NULL) {
-		/* we have nothing to set here */
-		return 1;
-	}
-
-	/* try to allocate new space, if we have to
-	 * before we damage something
-	 */
-	if(new_text) {
-		slen = strlen(new_text);
-		new_p = malloc(slen + 1);
-		if(new_p==NULL) {
-			/* return -- out of mem */
-			errno = ENOMEM;
-			return 0;
-		}
-		memcpy((void*)new_p, (void*)new_text, slen + 1);
-	}
-
-	/* clear previous text */
-	if(*ptext!=NULL) {
-		free((void*)*ptext);
-		*ptext = NULL;
+	return qcs__setfield(msg, which,
+		new_text, new_text ? strlen(new_text): 0);
+}
 
-		/* return if we have nothing to set */
-		if(new_text==NULL) {
-			return 1;
-		}
+int qcs_msgfromview(
+	qcs_msg * msg,
+	const qcs_msg_view * view )
+{
+	if(!msg || !view) {
+		errno = EINVAL;
+		return 0;
 	}
 
-	/* set new text */
-	*ptext = new_p;
-
-	return 1;
+	return qcs__materialize(view, msg);
 }
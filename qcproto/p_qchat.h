@@ -27,8 +27,17 @@
 #ifndef P_QCHAT_H 
 #define P_QCHAT_H
 
-const char * qcs__make_qchat_msg(const qcs_msg *, int *);
-int qcs__parse_qchat_msg(const char *, int, qcs_msg *);
+struct sock_filter;
+struct qcs__slot;
+
+int qcs__encode_qchat(const qcs_msg_view *, char *, size_t, size_t *);
+int qcs__prepare_qchat(const qcs_msg_view *, unsigned int,
+		struct qcs__slot *, int *, char *, size_t, size_t *);
+int qcs__peek_qchat(const char *, int, qcs_msg_peek *);
+int qcs__parse_qchat_view(const char *, int, qcs_msg_view *,
+		struct qcs__filter *);
+int qcs__msgfilter_qchat(const enum qcs_msgid *, unsigned int,
+		struct sock_filter *, int);
 
 
 #endif	/* P_QCHAT_H */
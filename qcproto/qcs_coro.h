@@ -0,0 +1,689 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	C++20 coroutine interface: QcsTask coroutines, run by a
+ *	QcsExecutor on a single thread, await messages and sends of
+ *	QcsAsyncLink links and timeouts, e.g.:
+ *
+ *	QcsTask<> info(QcsAsyncLink & link, QcsMessage req) {
+ *		auto reply = co_await link.request(std::move(req),
+ *			QCS_MSG_INFO_REPLY, 2000);
+ *		...
+ *	}
+ *
+ *	QcsExecutor exec;
+ *	QcsAsyncLink link(exec, qcs_open(...));
+ *	exec.spawn(info(link, ...));
+ *	exec.run();
+ *
+ *	The executor waits on a qcs_linkset (epoll), that the links are
+ *	added to: it serves send queues of paced/non-blocking links too
+ */
+
+#ifndef QCS_CORO_H
+#define QCS_CORO_H
+
+#if __cplusplus < 202002L
+#error "qcs_coro.h needs C++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <system_error>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <strings.h>
+
+#include "qcs_link.h"
+
+/* messages kept for recv()s to come, when none matches (per link) */
+#define QCS_CORO_BACKLOG	0x100
+
+/* links taken from the set by a single qcs_linkset_wait() */
+#define QCS_CORO_READY		0x40
+
+class QcsExecutor;
+class QcsAsyncLink;
+template<class T = void> class QcsTask;
+
+/* QcsTimed:
+ *	awaiter with a deadline on the executor (internal) */
+class QcsTimed {
+	friend class QcsExecutor;
+	std::multimap<unsigned long long, QcsTimed *>::iterator m_timer;
+	bool m_armed = false;
+protected:
+	QcsTimed() = default;
+	~QcsTimed() = default;
+	/* expire:
+	 *	deadline has passed: resume the awaiting coroutine */
+	virtual void expire() = 0;
+};
+
+/* QcsPromise:
+ *	promise of QcsTask, but its result (internal) */
+class QcsPromise {
+public:
+	std::coroutine_handle<> m_continuation;	/* awaiting coroutine */
+	QcsExecutor * m_spawned = nullptr;	/* executor running it */
+	std::exception_ptr m_error;
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+
+	struct Final {
+		bool await_ready() noexcept { return false; }
+		template<class P> std::coroutine_handle<> await_suspend(
+			std::coroutine_handle<P> h) noexcept;
+		void await_resume() noexcept {}
+	};
+	Final final_suspend() noexcept { return {}; }
+
+	void unhandled_exception() { m_error = std::current_exception(); }
+};
+
+/* QcsTask:
+ *	lazily started coroutine: runs, when it is co_await'ed
+ *	or spawned on an executor, and resumes its awaiter with
+ *	the co_return'ed value when done (exceptions propagate) */
+template<class T> class QcsTask {
+public:
+	class promise_type: public QcsPromise {
+	public:
+		std::optional<T> m_value;
+
+		QcsTask get_return_object() {
+			return QcsTask(std::coroutine_handle<promise_type>
+				::from_promise(*this));
+		}
+		template<class V> void return_value(V && value) {
+			m_value.emplace(std::forward<V>(value));
+		}
+	};
+
+	QcsTask(QcsTask && other) noexcept
+		: m_handle(std::exchange(other.m_handle, nullptr)) {}
+	QcsTask & operator=(QcsTask && other) noexcept {
+		if(this!=&other) {
+			if(m_handle) m_handle.destroy();
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+		return *this;
+	}
+	~QcsTask() { if(m_handle) m_handle.destroy(); }
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
+		m_handle.promise().m_continuation = h;
+		return m_handle;
+	}
+	T await_resume() {
+		if(m_handle.promise().m_error) {
+			std::rethrow_exception(m_handle.promise().m_error);
+		}
+		return std::move(*m_handle.promise().m_value);
+	}
+
+private:
+	friend class QcsExecutor;
+	explicit QcsTask(std::coroutine_handle<promise_type> h): m_handle(h) {}
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+template<> class QcsTask<void> {
+public:
+	class promise_type: public QcsPromise {
+	public:
+		QcsTask get_return_object() {
+			return QcsTask(std::coroutine_handle<promise_type>
+				::from_promise(*this));
+		}
+		void return_void() {}
+	};
+
+	QcsTask(QcsTask && other) noexcept
+		: m_handle(std::exchange(other.m_handle, nullptr)) {}
+	QcsTask & operator=(QcsTask && other) noexcept {
+		if(this!=&other) {
+			if(m_handle) m_handle.destroy();
+			m_handle = std::exchange(other.m_handle, nullptr);
+		}
+		return *this;
+	}
+	~QcsTask() { if(m_handle) m_handle.destroy(); }
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
+		m_handle.promise().m_continuation = h;
+		return m_handle;
+	}
+	void await_resume() {
+		if(m_handle.promise().m_error) {
+			std::rethrow_exception(m_handle.promise().m_error);
+		}
+	}
+
+private:
+	friend class QcsExecutor;
+	explicit QcsTask(std::coroutine_handle<promise_type> h): m_handle(h) {}
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+/* QcsExecutor:
+ *	runs spawned tasks on the calling thread of run(), resuming
+ *	them as their links get input and their deadlines pass */
+class QcsExecutor {
+public:
+	QcsExecutor() {
+		m_set = qcs_newlinkset();
+		if(m_set==NULL || !qcs_linkset_fd(m_set, &m_fd)) {
+			throw std::system_error(errno, std::generic_category(),
+				"qcs_newlinkset");
+		}
+	}
+	~QcsExecutor() { qcs_deletelinkset(m_set); }
+	QcsExecutor(const QcsExecutor &) = delete;
+	QcsExecutor & operator=(const QcsExecutor &) = delete;
+
+	/* spawn:
+	 *	starts task with the next run() round; the executor
+	 *	owns it, until it is done */
+	void spawn(QcsTask<> task) {
+		std::coroutine_handle<> h = task.m_handle;
+		task.m_handle.promise().m_spawned = this;
+		task.m_handle = nullptr;
+		m_tasks ++;
+		schedule(h);
+	}
+
+	/* run:
+	 *	runs tasks, until all the spawned ones are done or
+	 *	stop() is called; rethrows the first exception, that
+	 *	escaped a spawned task (the task is done then) */
+	void run() {
+		m_stop = false;
+		for(;;) {
+			while(!m_ready.empty() && !m_stop) {
+				std::coroutine_handle<> h = m_ready.front();
+				m_ready.pop_front();
+				h.resume();
+			}
+			if(m_stop || m_tasks==0) {
+				break;
+			}
+
+			struct pollfd pfd = { m_fd, POLLIN, 0 };
+			if(poll(&pfd, 1, nextTimeout()) < 0 && errno!=EINTR) {
+				throw std::system_error(errno,
+					std::generic_category(), "poll");
+			}
+			if(pfd.revents & POLLIN) {
+				serveLinks();
+			}
+			expireTimers();
+		}
+
+		if(m_error) {
+			std::rethrow_exception(std::exchange(m_error, nullptr));
+		}
+	}
+
+	/* stop:
+	 *	makes run() return, after the coroutine being run
+	 *	suspends (tasks are kept for the next run()) */
+	void stop() { m_stop = true; }
+
+	/* sleep:
+	 *	awaitable, that resumes after timeout_ms */
+	class SleepAwaiter: QcsTimed {
+		friend class QcsExecutor;
+		QcsExecutor & m_exec;
+		int m_timeout;
+		std::coroutine_handle<> m_handle;
+
+		SleepAwaiter(QcsExecutor & exec, int timeout_ms)
+			: m_exec(exec), m_timeout(timeout_ms) {}
+		void expire() override { m_exec.schedule(m_handle); }
+	public:
+		~SleepAwaiter() { m_exec.disarm(this); }
+		bool await_ready() const { return m_timeout <= 0; }
+		void await_suspend(std::coroutine_handle<> h) {
+			m_handle = h;
+			m_exec.arm(this, m_timeout);
+		}
+		void await_resume() {}
+	};
+	SleepAwaiter sleep(int timeout_ms) {
+		return SleepAwaiter(*this, timeout_ms);
+	}
+
+	/* now:
+	 *	monotonic clock, in ns	*/
+	static unsigned long long now() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+
+private:
+	friend class QcsAsyncLink;
+	friend class QcsPromise;
+
+	void schedule(std::coroutine_handle<> h) { m_ready.push_back(h); }
+
+	/* arm, disarm:
+	 *	sets/cancels deadline of t (timeout_ms < 0 - none) */
+	void arm(QcsTimed * t, int timeout_ms) {
+		if(timeout_ms < 0) {
+			return;
+		}
+		t->m_timer = m_timers.emplace(
+			now() + timeout_ms * 1000000ULL, t);
+		t->m_armed = true;
+	}
+	void disarm(QcsTimed * t) {
+		if(t->m_armed) {
+			m_timers.erase(t->m_timer);
+			t->m_armed = false;
+		}
+	}
+
+	/* nextTimeout:
+	 *	poll() timeout until the earliest deadline	*/
+	int nextTimeout() const {
+		unsigned long long t;
+
+		if(!m_ready.empty()) {
+			return 0;
+		}
+		if(m_timers.empty()) {
+			return -1;
+		}
+		t = now();
+		if(m_timers.begin()->first <= t) {
+			return 0;
+		}
+		return (m_timers.begin()->first - t + 999999) / 1000000;
+	}
+
+	void expireTimers() {
+		unsigned long long t = now();
+		QcsTimed * timed;
+
+		while(!m_timers.empty() && m_timers.begin()->first <= t) {
+			timed = m_timers.begin()->second;
+			m_timers.erase(m_timers.begin());
+			timed->m_armed = false;
+			timed->expire();
+		}
+	}
+
+	inline void serveLinks();
+
+	void taskDone(std::exception_ptr error) {
+		m_tasks --;
+		if(error && !m_error) {
+			m_error = error;
+			m_stop = true;
+		}
+	}
+
+	qcs_linkset m_set;
+	int m_fd;
+	std::deque<std::coroutine_handle<>> m_ready;
+	std::multimap<unsigned long long, QcsTimed *> m_timers;
+	std::unordered_map<qcs_link, QcsAsyncLink *> m_links;
+	unsigned long m_tasks = 0;	/* spawned and not done yet */
+	bool m_stop = false;
+	std::exception_ptr m_error;
+};
+
+template<class P> std::coroutine_handle<> QcsPromise::Final::await_suspend(
+	std::coroutine_handle<P> h) noexcept
+{
+	QcsPromise & promise = h.promise();
+
+	if(promise.m_spawned) {
+		/* owned by the executor: done with it */
+		promise.m_spawned->taskDone(promise.m_error);
+		h.destroy();
+		return std::noop_coroutine();
+	}
+	if(promise.m_continuation) {
+		return promise.m_continuation;
+	}
+	return std::noop_coroutine();
+}
+
+/* QcsAsyncLink:
+ *	link, that coroutines of the executor await messages on
+ *	(the link stays open, when QcsAsyncLink is destroyed, and is
+ *	to be closed after that, with no coroutine awaiting it
+ *	any more). A message received
+ *	goes to the first recv() awaiting it, or the backlog, for the
+ *	recv()s to come */
+class QcsAsyncLink {
+public:
+	typedef std::function<bool(const QcsMessage &)> Match;
+
+	QcsAsyncLink(QcsExecutor & exec, qcs_link link)
+		: m_exec(exec), m_link(link)
+	{
+		if(!qcs_linkset_add(exec.m_set, link)) {
+			throw std::system_error(errno, std::generic_category(),
+				"qcs_linkset_add");
+		}
+		exec.m_links[link] = this;
+	}
+	QcsAsyncLink(QcsExecutor & exec, QcsLink & link)
+		: QcsAsyncLink(exec, link.handle()) {}
+	~QcsAsyncLink() {
+		m_exec.m_links.erase(m_link);
+		qcs_linkset_remove(m_exec.m_set, m_link);
+	}
+	QcsAsyncLink(const QcsAsyncLink &) = delete;
+	QcsAsyncLink & operator=(const QcsAsyncLink &) = delete;
+
+	qcs_link handle() const { return m_link; }
+
+	/* dropped:
+	 *	messages dropped off the full backlog	*/
+	unsigned long long dropped() const { return m_dropped; }
+
+	/* RecvAwaiter:
+	 *	resumes with the message, or std::nullopt on timeout */
+	class RecvAwaiter: QcsTimed {
+		friend class QcsAsyncLink;
+		QcsAsyncLink & m_link;
+		Match m_match;		/* empty - any message */
+		int m_timeout;
+		std::optional<QcsMessage> m_result;
+		std::coroutine_handle<> m_handle;
+		RecvAwaiter * m_prev = nullptr, * m_next = nullptr;
+		bool m_waiting = false;
+
+		RecvAwaiter(QcsAsyncLink & link, Match match, int timeout_ms)
+			: m_link(link), m_match(std::move(match)),
+			m_timeout(timeout_ms) {}
+		bool matches(const QcsMessage & msg) const {
+			return !m_match || m_match(msg);
+		}
+		void expire() override {
+			m_link.unwait(this);
+			m_link.m_exec.schedule(m_handle);
+		}
+	public:
+		~RecvAwaiter() {
+			m_link.unwait(this);
+			m_link.m_exec.disarm(this);
+		}
+		bool await_ready() { return m_link.takeBacklog(*this); }
+		void await_suspend(std::coroutine_handle<> h) {
+			m_handle = h;
+			m_link.wait(this);
+			m_link.m_exec.arm(this, m_timeout);
+		}
+		std::optional<QcsMessage> await_resume() {
+			return std::move(m_result);
+		}
+	};
+
+	/* recv:
+	 *	awaits the next message (that match accepts), for up
+	 *	to timeout_ms (< 0 - no timeout)	*/
+	RecvAwaiter recv(int timeout_ms = -1) {
+		return RecvAwaiter(*this, Match(), timeout_ms);
+	}
+	RecvAwaiter recv(Match match, int timeout_ms = -1) {
+		return RecvAwaiter(*this, std::move(match), timeout_ms);
+	}
+
+	/* SendAwaiter:
+	 *	resumes with true, once the message is sent (or queued,
+	 *	see qcs_send_batch); suspends only while the send queue
+	 *	of a paced/non-blocking link is full. Resumes with false
+	 *	on error or timeout (errno is ETIMEDOUT then) */
+	class SendAwaiter: QcsTimed {
+		friend class QcsAsyncLink;
+		QcsAsyncLink & m_link;
+		qcs_msg_view m_view;
+		int m_timeout;
+		bool m_sent = false;
+		int m_errno = 0;
+		std::coroutine_handle<> m_handle;
+		SendAwaiter * m_prev = nullptr, * m_next = nullptr;
+		bool m_waiting = false;
+
+		SendAwaiter(QcsAsyncLink & link,
+			const qcs_msg_view & view, int timeout_ms)
+			: m_link(link), m_view(view), m_timeout(timeout_ms) {}
+
+		/* trySend:
+		 *	false, if the queue is still full (not trying
+		 *	then, not to count queue drops, that are not) */
+		bool trySend() {
+			unsigned int queued;
+
+			if(m_link.m_full
+				&& qcs_txqueue(m_link.m_link, &queued, NULL)
+				&& queued >= m_link.m_full)
+			{
+				return false;
+			}
+			if(qcs_send_view(m_link.m_link, &m_view)) {
+				m_sent = true;
+				return true;
+			}
+			m_errno = errno;
+			if(m_errno!=ENOBUFS) {
+				return true;
+			}
+			qcs_txqueue(m_link.m_link, &m_link.m_full, NULL);
+			return false;
+		}
+		void expire() override {
+			m_link.unblock(this);
+			m_errno = ETIMEDOUT;
+			m_link.m_exec.schedule(m_handle);
+		}
+	public:
+		~SendAwaiter() {
+			m_link.unblock(this);
+			m_link.m_exec.disarm(this);
+		}
+		bool await_ready() {
+			/* keep order behind blocked sends */
+			return m_link.m_blocked_head==nullptr && trySend();
+		}
+		void await_suspend(std::coroutine_handle<> h) {
+			m_handle = h;
+			m_link.block(this);
+			m_link.m_exec.arm(this, m_timeout);
+		}
+		bool await_resume() {
+			if(!m_sent) errno = m_errno;
+			return m_sent;
+		}
+	};
+
+	/* send:
+	 *	awaits sending of the message (it must not change,
+	 *	until the send is done)	*/
+	SendAwaiter send(const QcsMessage & msg, int timeout_ms = -1) {
+		return SendAwaiter(*this, msg.view(), timeout_ms);
+	}
+	SendAwaiter send(const qcs_msg_view & view, int timeout_ms = -1) {
+		return SendAwaiter(*this, view, timeout_ms);
+	}
+
+	/* request:
+	 *	sends req and awaits reply_id message from its
+	 *	destination to its source (nicknames compared without
+	 *	case), timeout_ms is for each of the two */
+	QcsTask<std::optional<QcsMessage>> request(
+		QcsMessage req, qcs_msgid reply_id, int timeout_ms = -1)
+	{
+		if(!co_await send(req, timeout_ms)) {
+			co_return std::nullopt;
+		}
+		co_return co_await recv(
+			[&req, reply_id](const QcsMessage & msg) {
+				return msg.msg()==reply_id
+					&& sameNick(msg.src(), req.dst())
+					&& (!req.has(QCS_SRC)
+						|| sameNick(msg.dst(), req.src()));
+			}, timeout_ms);
+	}
+
+	static bool sameNick(std::string_view a, std::string_view b) {
+		return a.size()==b.size()
+			&& !strncasecmp(a.data(), b.data(), a.size());
+	}
+
+private:
+	friend class QcsExecutor;
+
+	/* drain:
+	 *	receives what is pending on the link (until EAGAIN),
+	 *	handing messages to the awaiting recv()s	*/
+	void drain() {
+		qcs_msg_view view;
+		RecvAwaiter * w;
+
+		for(;;) {
+			if(!qcs_recv_view(m_link, &view)) {
+				if(errno==ENOMSG) {
+					/* malformed datagram: the rest
+					 * is still to be read */
+					continue;
+				}
+				break;
+			}
+			if(view.msg==QCS_MSG_INVALID) {
+				/* filtered out, duplicate */
+				continue;
+			}
+			m_msg.assign(view);
+
+			for(w = m_waiting_head; w; w = w->m_next) {
+				if(w->matches(m_msg)) {
+					break;
+				}
+			}
+			if(w) {
+				w->m_result.emplace(std::move(m_msg));
+				unwait(w);
+				m_exec.disarm(w);
+				m_exec.schedule(w->m_handle);
+				continue;
+			}
+
+			if(m_backlog.size()==QCS_CORO_BACKLOG) {
+				m_backlog.pop_front();
+				m_dropped ++;
+			}
+			m_backlog.push_back(std::move(m_msg));
+		}
+	}
+
+	bool takeBacklog(RecvAwaiter & w) {
+		for(auto it = m_backlog.begin(); it!=m_backlog.end(); ++it) {
+			if(w.matches(*it)) {
+				w.m_result.emplace(std::move(*it));
+				m_backlog.erase(it);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/* retrySends:
+	 *	sends what fits into the queue now, in order */
+	void retrySends() {
+		SendAwaiter * s;
+
+		while((s = m_blocked_head)!=nullptr && s->trySend()) {
+			unblock(s);
+			m_exec.disarm(s);
+			m_exec.schedule(s->m_handle);
+		}
+	}
+
+	/* wait, unwait, block, unblock:
+	 *	(un)links awaiters in the lists of the link	*/
+	template<class A> static void append(A * a, A *& head, A *& tail) {
+		a->m_prev = tail;
+		a->m_next = nullptr;
+		(tail ? tail->m_next: head) = a;
+		tail = a;
+		a->m_waiting = true;
+	}
+	template<class A> static void remove(A * a, A *& head, A *& tail) {
+		if(!a->m_waiting) {
+			return;
+		}
+		(a->m_prev ? a->m_prev->m_next: head) = a->m_next;
+		(a->m_next ? a->m_next->m_prev: tail) = a->m_prev;
+		a->m_waiting = false;
+	}
+	void wait(RecvAwaiter * w) { append(w, m_waiting_head, m_waiting_tail); }
+	void unwait(RecvAwaiter * w) { remove(w, m_waiting_head, m_waiting_tail); }
+	void block(SendAwaiter * s) { append(s, m_blocked_head, m_blocked_tail); }
+	void unblock(SendAwaiter * s) { remove(s, m_blocked_head, m_blocked_tail); }
+
+	QcsExecutor & m_exec;
+	qcs_link m_link;
+	QcsMessage m_msg;	/* being received */
+	std::deque<QcsMessage> m_backlog;
+	unsigned long long m_dropped = 0;
+	unsigned int m_full = 0;	/* queued, when the queue was full */
+	RecvAwaiter * m_waiting_head = nullptr, * m_waiting_tail = nullptr;
+	SendAwaiter * m_blocked_head = nullptr, * m_blocked_tail = nullptr;
+};
+
+/* serveLinks:
+ *	drains links with input, flushes send queues	*/
+void QcsExecutor::serveLinks()
+{
+	qcs_link ready[QCS_CORO_READY];
+	int i, n;
+
+	n = qcs_linkset_wait(m_set, ready, QCS_CORO_READY, 0);
+	for(i = 0; i < n; i++) {
+		auto it = m_links.find(ready[i]);
+		if(it!=m_links.end()) {
+			it->second->drain();
+		}
+	}
+
+	/* queues may have room now */
+	for(auto & link: m_links) {
+		link.second->retrySends();
+	}
+}
+
+#endif	/* QCS_CORO_H */
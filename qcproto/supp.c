@@ -28,6 +28,11 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 #include "qcs_link.h"
 #include "supp.h"
@@ -55,164 +60,424 @@ int qcs__net_qcmode(int local)
 	return '0';	/* let's assume we didn't see this :) */
 }
 
+/* msg_field:
+ *	returns pointer to message field */
+static char ** msg_field(qcs_msg * msg, enum qcs_textid which)
+{
+	switch(which) {
+	case QCS_SRC: return &msg->src;
+	case QCS_DST: return &msg->dst;
+	case QCS_TEXT: return &msg->text;
+	case QCS_SUPP: return &msg->supp;
+	case QCS_CHAN: return &msg->chan;
+	}
+	return NULL;
+}
+
+/* struct msg_block:
+ *	message with its field storage, as qcs__allocmsg() makes it */
+struct msg_block {
+	qcs_msg msg;
+	struct qcs__msg_store store;
+};
+
+qcs_msg * qcs__allocmsg()
+{
+	struct msg_block * block;
+	int i;
+
+	block = malloc(sizeof(struct msg_block));
+	if(block==NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	memset(&block->msg, 0, sizeof(qcs_msg));
+	block->msg.msg = QCS_MSG_INVALID;
+	block->msg.mode = QCS_UMODE_INVALID;
+	block->msg.store = &block->store;
+
+	for(i = 0; i < QCS_MSG_FIELDS; i++) {
+		block->store.bufs[i] = block->store.inline_bufs[i];
+		block->store.caps[i] = QCS_MSG_INLINE;
+	}
+	block->store.next = NULL;
+
+	return &block->msg;
+}
+
+void qcs__freemsg(qcs_msg * msg)
+{
+	struct qcs__msg_store * store = msg->store;
+	int i;
+
+	if(store==NULL) {
+		/* fields are malloc'ed one by one */
+		qcs__cleanupmsg(msg);
+		free(msg);
+		return;
+	}
+
+	for(i = 0; i < QCS_MSG_FIELDS; i++) {
+		if(store->bufs[i]!=store->inline_bufs[i]) {
+			free(store->bufs[i]);
+		}
+	}
+	free(msg);
+}
+
 void qcs__cleanupmsg(
 	qcs_msg * msg )
 {
 	assert(msg);
 	msg->msg=QCS_MSG_INVALID;
+	memset(&msg->rx, 0, sizeof(qcs_rxinfo));
+
+	if(msg->store) {
+		/* keep the buffers for the next use */
+		msg->src = msg->dst = msg->text = msg->supp = msg->chan = NULL;
+		return;
+	}
 	if(msg->text){free(msg->text);msg->text=NULL;}
 	if(msg->supp){free(msg->supp);msg->supp=NULL;}
 	if(msg->src){free(msg->src);msg->src=NULL;}
 	if(msg->dst){free(msg->dst);msg->dst=NULL;}
 	if(msg->chan){free(msg->chan);msg->chan=NULL;}
 }
-char * qcs__gatherstr(
-	const char ** str, int * len)
+
+int qcs__setfield(
+	qcs_msg * msg,
+	enum qcs_textid which,
+	const char * str, int len )
 {
-	char *retstr;
-	const char * t;
-	int ln;
+	struct qcs__msg_store * store = msg->store;
+	char ** pfield = msg_field(msg, which), * buf;
+	unsigned int cap;
 
-	assert(str && *str && len);
+	assert(pfield);
 
-	if(*len<0) return NULL;
+	if(str==NULL) {
+		if(store==NULL) {
+			free(*pfield);
+		}
+		*pfield = NULL;
+		return 1;
+	}
 
-	t = *str;
-	ln = *len;
+	if(store==NULL) {
+		/* allocate new space before we damage something */
+		buf = malloc(len + 1);
+		if(buf==NULL) {
+			errno = ENOMEM;
+			return 0;
+		}
+		memcpy(buf, str, len);
+		buf[len] = '\0';
 
-	while(ln && *t!='\0') {
-		ln--; t++;
+		free(*pfield);
+		*pfield = buf;
+		return 1;
 	}
-	if(ln==0) return NULL;
-	ln = *len - ln + 1;
 
-	retstr = malloc(ln);
-	if(retstr==NULL) {
-		errno = ENOMEM;
-		return NULL;
+	if((unsigned int)len + 1 > store->caps[which]) {
+		/* outgrown the buffer: replace it with a bigger one */
+		for(cap = store->caps[which] * 2; cap < (unsigned int)len + 1; cap *= 2)
+			;
+		buf = malloc(cap);
+		if(buf==NULL) {
+			errno = ENOMEM;
+			return 0;
+		}
+		memcpy(buf, str, len);
+
+		if(store->bufs[which]!=store->inline_bufs[which]) {
+			free(store->bufs[which]);
+		}
+		store->bufs[which] = buf;
+		store->caps[which] = cap;
+	} else {
+		/* str may be the field itself */
+		memmove(store->bufs[which], str, len);
 	}
-	memcpy(retstr, *str, ln);
 
-	*len -= ln;
-	*str += ln;
+	store->bufs[which][len] = '\0';
+	*pfield = store->bufs[which];
+	return 1;
+}
+
+/* INDEX_MASK:
+ *	appends offsets of '\0's found in the mask to offs */
+#define INDEX_MASK(mask, base) do {\
+	while(mask) {					\
+		offs[count++] = (base) + __builtin_ctz(mask);	\
+		mask &= mask - 1;			\
+	}}while(0)
+
+int qcs__index_fields(
+	const char * buf, int len,
+	unsigned short * offs )
+{
+	int i = 0, count = 0;
+	unsigned int mask;
+
+	assert(buf && offs && len >= 0);
+
+#ifdef __AVX2__
+	for(; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		mask = _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+		INDEX_MASK(mask, i);
+	}
+#endif
+#ifdef __SSE2__
+	for(; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+		mask = _mm_movemask_epi8(
+			_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+		INDEX_MASK(mask, i);
+	}
+#endif
+	/* the tail (or everything, if no SIMD) */
+	for(; i < len; i++) {
+		if(buf[i]=='\0') {
+			offs[count++] = i;
+		}
+	}
 
-	return retstr;
+	return count;
+}
+
+int qcs__materialize(
+	const qcs_msg_view * view,
+	qcs_msg * msg )
+{
+	assert(view && msg);
+
+	qcs__cleanupmsg(msg);
+
+	if(!qcs__setfield(msg, QCS_SRC, view->src.str, view->src.len)
+		|| !qcs__setfield(msg, QCS_DST, view->dst.str, view->dst.len)
+		|| !qcs__setfield(msg, QCS_TEXT, view->text.str, view->text.len)
+		|| !qcs__setfield(msg, QCS_SUPP, view->supp.str, view->supp.len)
+		|| !qcs__setfield(msg, QCS_CHAN, view->chan.str, view->chan.len))
+	{
+		qcs__cleanupmsg(msg);
+		return 0;
+	}
+
+	msg->msg = view->msg;
+	msg->mode = view->mode;
+	msg->rx = view->rx;
+	return 1;
+}
+
+/* view_field:
+ *	points strview at message field	*/
+static void view_field(qcs_strview * field, const char * str)
+{
+	field->str = str;
+	field->len = str ? (int)strlen(str): 0;
+}
+
+void qcs__viewmsg(
+	const qcs_msg * msg,
+	qcs_msg_view * view )
+{
+	assert(msg && view);
+
+	view->msg = msg->msg;
+	view->mode = msg->mode;
+	view_field(&view->src, msg->src);
+	view_field(&view->dst, msg->dst);
+	view_field(&view->text, msg->text);
+	view_field(&view->supp, msg->supp);
+	view_field(&view->chan, msg->chan);
+	view->rx = msg->rx;
 }
 
 /** signature checking stuff ***
   ****************************/
 
-#define QCS_SIGNATURE_MAX_DUP	(0x20)
-
-/* struct dup_entry:
- *	defines list node for duplicated check
- */
-struct dup_entry {
-	char 	signature[ QCS_SIGNATURE_LENGTH ];
-	struct dup_entry
-		* next, * prev;
-};
 #define EQ_SIGNATURE(s1,s2)	(memcmp((s1),(s2),QCS_SIGNATURE_LENGTH)==0)
 #define CP_SIGNATURE(d,s)	memcpy((d),(s),QCS_SIGNATURE_LENGTH)
+#define RING_SIGNATURE(c,i)	((c)->ring + (i) * QCS_SIGNATURE_LENGTH)
 
-static struct dup_entry * dup_head = NULL, * dup_tail = NULL;
-static int dup_count = 0;
-
-int qcs__known_dup_entry(
-	const char *signature )
+/* signature_hash:
+ *	FNV-1a hash of the signature		*/
+static unsigned int signature_hash(const char * signature)
 {
-	struct dup_entry * e;
+	unsigned int h = 2166136261U;
+	int i;
 
-	/* search for specified signature */
-	for( e = dup_head; e; e = e->next ) {
-		if( EQ_SIGNATURE(e->signature, signature) ) {
-			return 1;
-		}
+	for(i = 0; i < QCS_SIGNATURE_LENGTH; i++) {
+		h ^= (unsigned char)signature[i];
+		h *= 16777619U;
 	}
-	return 0;
+	return h;
 }
 
-void qcs__remove_last_entry()
+int qcs__dup_init(
+	struct qcs__dup_cache * cache,
+	unsigned int size )
 {
-	struct dup_entry * dead;
-
-	assert(dup_count!=0);
-
-	/* adjust list references */
-	dead = dup_tail;
-	if( dup_head==dup_tail ) {
-		dup_head = dup_tail = NULL;
-	} else {
-		dup_tail = dup_tail->prev;
-		dup_tail->next = NULL;
+	unsigned int table_size;
+
+	assert(cache && size);
+
+	/* keep the table at most half full */
+	for(table_size = 1; table_size < size * 2; table_size <<= 1)
+		;
+
+	cache->size = size;
+	cache->mask = table_size - 1;
+	cache->ring = malloc(size * QCS_SIGNATURE_LENGTH);
+	cache->hashes = malloc(size * sizeof(unsigned int));
+	cache->table = malloc(table_size * sizeof(int));
+	cache->hits = 0;
+
+	if(!cache->ring || !cache->hashes || !cache->table) {
+		free(cache->ring);
+		free(cache->hashes);
+		free(cache->table);
+		cache->ring = NULL;
+		cache->hashes = NULL;
+		cache->table = NULL;
+		errno = ENOMEM;
+		return 0;
 	}
-	dup_count --;
 
-	/* free entry */
-	free( dead );
+	qcs__dup_flush(cache);
+	return 1;
 }
 
-int qcs__insert_dup_entry(
-	const char *signature )
+void qcs__dup_free(struct qcs__dup_cache * cache)
 {
-	struct dup_entry * e;
+	free(cache->ring);
+	free(cache->hashes);
+	free(cache->table);
+}
 
-	assert(signature != NULL);
+void qcs__dup_flush(struct qcs__dup_cache * cache)
+{
+	/* all bits set: every slot is -1 */
+	memset(cache->table, 0xff, (cache->mask + 1) * sizeof(int));
+	cache->count = cache->head = 0;
+}
 
-	/* memalloc can fail here, before it does any harm */
-	e = malloc(sizeof(struct dup_entry));
-	if( e==NULL ) {
-		errno = ENOMEM;
-		return 0;
+/* dup_remove:
+ *	removes ring entry from the hash table, shifting
+ *	following entries of the probe sequence back	*/
+static void dup_remove(
+	struct qcs__dup_cache * cache,
+	int entry )
+{
+	unsigned int i, j, home;
+
+	/* find the slot */
+	i = cache->hashes[entry] & cache->mask;
+	while(cache->table[i]!=entry) {
+		assert(cache->table[i]!=-1);
+		i = (i + 1) & cache->mask;
 	}
 
-	/* check for overflow */
-	if( dup_count==QCS_SIGNATURE_MAX_DUP ) {
-		qcs__remove_last_entry();
+	/* backward-shift deletion: no tombstones needed */
+	for(j = i;;) {
+		cache->table[i] = -1;
+		do {
+			j = (j + 1) & cache->mask;
+			if(cache->table[j]==-1) {
+				return;
+			}
+			home = cache->hashes[cache->table[j]] & cache->mask;
+
+			/* leave the entry, if its home slot
+			 * is cyclically within (i, j] */
+		} while(i <= j ? (i < home && home <= j)
+				: (i < home || home <= j));
+
+		cache->table[i] = cache->table[j];
+		i = j;
 	}
+}
+
+int qcs__dup_check(
+	struct qcs__dup_cache * cache,
+	const char * signature )
+{
+	unsigned int h, i;
+	int entry;
+
+	assert(cache && signature);
 
-	/* setup and insert new signature */
-	e->prev = NULL;
-	e->next = dup_head;
-	CP_SIGNATURE(e->signature, signature);
+	/* search for specified signature */
+	h = signature_hash(signature);
+	for(i = h & cache->mask; cache->table[i]!=-1; i = (i + 1) & cache->mask) {
+		entry = cache->table[i];
+		if(cache->hashes[entry]==h
+			&& EQ_SIGNATURE(RING_SIGNATURE(cache, entry), signature))
+		{
+			QCS_COUNT(cache->hits, 1);
+			return 1;
+		}
+	}
 
-	if(!dup_count) {
-		dup_tail = e;
+	/* not seen before: register, evicting the oldest one */
+	entry = cache->head;
+	if(cache->count==cache->size) {
+		dup_remove(cache, entry);
 	} else {
-		dup_head->prev = e;
+		cache->count ++;
 	}
-	dup_head = e;
+	cache->head = (cache->head + 1) % cache->size;
 
-	dup_count ++;
+	CP_SIGNATURE(RING_SIGNATURE(cache, entry), signature);
+	cache->hashes[entry] = h;
 
-	return 1;
+	/* insert at the end of its probe sequence */
+	for(i = h & cache->mask; cache->table[i]!=-1; i = (i + 1) & cache->mask)
+		;
+	cache->table[i] = entry;
+
+	return 0;
 }
 
-void qcs__generate_signature(char * buf)
+/* signature_rand:
+ *	xorshift32 step on the link's generator state	*/
+static unsigned int signature_rand(unsigned int * seed)
 {
-	int i;
+	unsigned int x = *seed;
 
-	*buf = 'X';
-	for(i=1; i < (1+QCS_SIGNATURE_LENGTH); i++) {
-		*(buf+i) = (unsigned char)('a'+rand()%('z'-'a'+1));
-	}
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *seed = x;
 }
 
-int qcs__cleanup_dup()
+void qcs__seed_signature(
+	unsigned int * seed,
+	const void * salt )
 {
-	/* free any dup entries allocated */
-	struct dup_entry * cur, * dead;
-	cur = dup_head;
-	while( cur != NULL ) {
-		dead = cur;
-		cur = cur->next;
-
-		free( dead );
+	struct timeval tv;
+
+	/* links opened at the same time must differ */
+	gettimeofday(&tv, NULL);
+	*seed = (unsigned int)tv.tv_sec ^ ((unsigned int)tv.tv_usec << 12)
+		^ ((unsigned int)getpid() << 20) ^ (unsigned int)(size_t)salt;
+	if(*seed==0) {
+		/* xorshift would get stuck at zero */
+		*seed = 0x9e3779b9U;
 	}
-	dup_head = dup_tail = NULL;
-	dup_count = 0;
-
-	return 1;
 }
 
+void qcs__generate_signature(
+	char * buf,
+	unsigned int * seed )
+{
+	int i;
 
+	*buf = 'X';
+	for(i=1; i < (1+QCS_SIGNATURE_LENGTH); i++) {
+		*(buf+i) = (unsigned char)('a'+signature_rand(seed)%('z'-'a'+1));
+	}
+}
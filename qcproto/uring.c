@@ -0,0 +1,321 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	io_uring module: rings set up & driven with raw syscalls
+ *	(no liburing), for links opened with QCS_BACKEND_URING
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "uring.h"
+
+static int sys_io_uring_setup(
+	unsigned int entries,
+	struct io_uring_params * params )
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(
+	int fd, unsigned int to_submit,
+	unsigned int min_complete, unsigned int flags )
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit,
+		min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(
+	int fd, unsigned int opcode,
+	void * arg, unsigned int nr_args )
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* qcs__uring_init:
+ *	sets up io_uring of `entries' sqes and `cq_entries' cqes
+ *	(0 - kernel default: twice the entries)
+ * returns:
+ *	non-0 on success,
+ *	0 on failure (ENOSYS: no io_uring or too old for us)
+ */
+int qcs__uring_init(
+	struct qcs__uring * ring,
+	unsigned int entries,
+	unsigned int cq_entries )
+{
+	struct io_uring_params params;
+	size_t cq_size;
+	char * rings;
+	int errbak;
+
+	memset(ring, 0, sizeof(struct qcs__uring));
+	ring->rings = ring->sqes = MAP_FAILED;
+
+	memset(&params, 0, sizeof(params));
+	if(cq_entries) {
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = cq_entries;
+	}
+
+	ring->fd = sys_io_uring_setup(entries, &params);
+	if(ring->fd < 0) {
+		return 0;
+	}
+
+	/* single mmap of both rings (5.4) and no cqe
+	 * ever dropped on overflow (5.5) */
+	if(!(params.features & IORING_FEAT_SINGLE_MMAP)
+		|| !(params.features & IORING_FEAT_NODROP))
+	{
+		errno = ENOSYS;
+		goto failed;
+	}
+
+	ring->rings_size = params.sq_off.array
+		+ params.sq_entries * sizeof(unsigned int);
+	cq_size = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+	if(cq_size > ring->rings_size) {
+		ring->rings_size = cq_size;
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->rings = mmap(NULL, ring->rings_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if(ring->rings==MAP_FAILED) {
+		goto failed;
+	}
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(ring->sqes==MAP_FAILED) {
+		goto failed;
+	}
+
+	rings = ring->rings;
+	ring->sq_khead = (unsigned int *)(rings + params.sq_off.head);
+	ring->sq_ktail = (unsigned int *)(rings + params.sq_off.tail);
+	ring->sq_array = (unsigned int *)(rings + params.sq_off.array);
+	ring->sq_mask = *(unsigned int *)(rings + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+	ring->sq_tail = *ring->sq_ktail;
+
+	ring->cq_khead = (unsigned int *)(rings + params.cq_off.head);
+	ring->cq_ktail = (unsigned int *)(rings + params.cq_off.tail);
+	ring->cq_mask = *(unsigned int *)(rings + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+
+	return 1;
+
+failed:
+	errbak = errno;
+	qcs__uring_free(ring);
+	errno = errbak;
+	return 0;
+}
+
+/* qcs__uring_free:
+ *	cancels whatever is in flight and tears down the ring	*/
+void qcs__uring_free(struct qcs__uring * ring)
+{
+	struct io_uring_sync_cancel_reg cancel;
+
+	if(ring->fd >= 0) {
+		/* no receive may land in the buffers once
+		 * they are released */
+		if(ring->br!=NULL) {
+			memset(&cancel, 0, sizeof(cancel));
+			cancel.fd = -1;
+			cancel.flags = IORING_ASYNC_CANCEL_ANY;
+			cancel.timeout.tv_sec = cancel.timeout.tv_nsec = -1;
+			sys_io_uring_register(ring->fd,
+				IORING_REGISTER_SYNC_CANCEL, &cancel, 1);
+		}
+		close(ring->fd);
+	}
+
+	if(ring->rings!=MAP_FAILED) munmap(ring->rings, ring->rings_size);
+	if(ring->sqes!=MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+	if(ring->br!=NULL) {
+		munmap(ring->br, ring->buf_count * sizeof(struct io_uring_buf));
+	}
+	free(ring->bufs);
+
+	ring->fd = -1;
+	ring->rings = ring->sqes = MAP_FAILED;
+	ring->br = NULL;
+	ring->bufs = NULL;
+}
+
+/* qcs__uring_setup_bufs:
+ *	provides `count' (a power of 2) buffers of `size' bytes to
+ *	the kernel, as buffer group 0 of the ring (5.19)	*/
+int qcs__uring_setup_bufs(
+	struct qcs__uring * ring,
+	unsigned int count,
+	size_t size )
+{
+	struct io_uring_buf_reg reg;
+	unsigned int i;
+	void * br;
+
+	br = mmap(NULL, count * sizeof(struct io_uring_buf),
+		PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if(br==MAP_FAILED) {
+		return 0;
+	}
+	ring->br = br;
+	ring->buf_count = count;
+	ring->buf_size = size;
+	ring->br_tail = 0;
+
+	ring->bufs = malloc(count * size);
+	if(ring->bufs==NULL) {
+		/* (released with the ring) */
+		errno = ENOMEM;
+		return 0;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)br;
+	reg.ring_entries = count;
+	reg.bgid = 0;
+	if(sys_io_uring_register(ring->fd,
+		IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		if(errno==EINVAL) {
+			errno = ENOSYS;
+		}
+		return 0;
+	}
+
+	for(i = 0; i < count; i++) {
+		qcs__uring_put_buf(ring, i);
+	}
+	return 1;
+}
+
+/* qcs__uring_put_buf:
+ *	gives buffer `bid' (back) to the kernel	*/
+void qcs__uring_put_buf(
+	struct qcs__uring * ring,
+	unsigned int bid )
+{
+	struct io_uring_buf * buf;
+
+	buf = &ring->br->bufs[ring->br_tail & (ring->buf_count - 1)];
+	buf->addr = (uintptr_t)QCS__URING_BUF(ring, bid);
+	buf->len = ring->buf_size;
+	buf->bid = bid;
+
+	ring->br_tail ++;
+	__atomic_store_n(&ring->br->tail, (__u16)ring->br_tail,
+		__ATOMIC_RELEASE);
+}
+
+/* qcs__uring_sqe:
+ *	returns next (zeroed) sqe to fill in, or NULL, if the
+ *	submission ring is full	*/
+struct io_uring_sqe * qcs__uring_sqe(struct qcs__uring * ring)
+{
+	struct io_uring_sqe * sqe;
+	unsigned int index;
+
+	if(ring->sq_tail - __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE)
+		>= ring->sq_entries)
+	{
+		return NULL;
+	}
+
+	index = ring->sq_tail & ring->sq_mask;
+	sqe = ring->sqes + index;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	ring->sq_array[index] = index;
+	ring->sq_tail ++;
+
+	return sqe;
+}
+
+/* qcs__uring_submit:
+ *	submits the sqes filled in and waits until at
+ *	least `wait_nr' cqes are ready
+ * returns:
+ *	non-0 on success,
+ *	0 on failure: the sqes not taken by the kernel are dropped
+ */
+int qcs__uring_submit(
+	struct qcs__uring * ring,
+	unsigned int wait_nr )
+{
+	unsigned int pending, ready;
+	int retval;
+
+	__atomic_store_n(ring->sq_ktail, ring->sq_tail, __ATOMIC_RELEASE);
+
+	for(;;) {
+		pending = ring->sq_tail
+			- __atomic_load_n(ring->sq_khead, __ATOMIC_ACQUIRE);
+		ready = __atomic_load_n(ring->cq_ktail, __ATOMIC_ACQUIRE)
+			- *ring->cq_khead;
+		if(!pending && ready >= wait_nr) {
+			return 1;
+		}
+
+		if(ready >= wait_nr) {
+			retval = sys_io_uring_enter(ring->fd, pending, 0, 0);
+		} else {
+			retval = sys_io_uring_enter(ring->fd, pending, wait_nr,
+				IORING_ENTER_GETEVENTS);
+		}
+		if(retval < 0 && errno!=EINTR) {
+			ring->sq_tail = __atomic_load_n(ring->sq_khead,
+				__ATOMIC_ACQUIRE);
+			__atomic_store_n(ring->sq_ktail, ring->sq_tail,
+				__ATOMIC_RELEASE);
+			return 0;
+		}
+	}
+}
+
+/* qcs__uring_cqe:
+ *	returns the oldest cqe ready, or NULL if there's none;
+ *	it stays in the ring till qcs__uring_cqe_seen()	*/
+struct io_uring_cqe * qcs__uring_cqe(struct qcs__uring * ring)
+{
+	unsigned int head = *ring->cq_khead;
+
+	if(head==__atomic_load_n(ring->cq_ktail, __ATOMIC_ACQUIRE)) {
+		return NULL;
+	}
+	return ring->cqes + (head & ring->cq_mask);
+}
+
+void qcs__uring_cqe_seen(struct qcs__uring * ring)
+{
+	__atomic_store_n(ring->cq_khead, *ring->cq_khead + 1,
+		__ATOMIC_RELEASE);
+}
@@ -67,6 +67,12 @@ struct config * read_config(
 	cfg->net_head = cfg->net_tail = NULL;
 	cfg->net_count = 0;
 	cfg->local_refresh_timeout = 30;
+	cfg->local_tx_rate = 0;
+	cfg->local_tx_burst = 0;
+	cfg->local_uring = 0;
+	cfg->local_mcast_ttl = 0;
+	cfg->local_mcast_loop = 1;
+	cfg->local_mcast_if = 0;
 
 	/** parse cmd-line params
 	 */
@@ -209,6 +215,7 @@ static int process_config_entry(
 	char * next_opt, * host;
 	unsigned short port;
 	enum qnet_type type;
+	struct in_addr in;
 	assert(name);
 
 	if(!strcasecmp(name, "first_id")) {
@@ -239,15 +246,18 @@ static int process_config_entry(
 		if(!next_opt) return 0;
 
 		/* extract connection type */
-		if(strcasecmp(opt, "VCHAT") && strcasecmp(opt, "QCHAT")) {
+		if(strcasecmp(opt, "VCHAT") && strcasecmp(opt, "QCHAT")
+			&& strcasecmp(opt, "AUTO"))
+		{
 			/* unknown/invalid local connection type */
 			log_a("process_config_entry: invalid local connection "
 				"type \"");
 			log_a(opt); log("\"");
 			return 0;
 		}
-		type = !strcasecmp(opt, "VCHAT")
-			? QNETTYPE_VYPRESS_CHAT: QNETTYPE_QUICK_CHAT;
+		type = !strcasecmp(opt, "VCHAT") ? QNETTYPE_VYPRESS_CHAT
+			: !strcasecmp(opt, "AUTO") ? QNETTYPE_AUTO_CHAT
+			: QNETTYPE_QUICK_CHAT;
 
 		/* extract port */
 		opt = next_opt;
@@ -293,6 +303,52 @@ static int process_config_entry(
 		cfg->local_refresh_timeout = atoi(opt);
 		return 1;
 	}
+	if(!strcasecmp(name, "local_tx_rate")) {
+		/* local_tx_rate <datagrams per sec> [<burst>] */
+		if(!opt) return 0;
+		next_opt = extract_next(opt);
+
+		cfg->local_tx_rate = atoi(opt);
+		if(next_opt) {
+			opt = next_opt;
+			next_opt = extract_next(opt);
+			if(next_opt) return 0;
+
+			cfg->local_tx_burst = atoi(opt);
+		}
+		return 1;
+	}
+	if(!strcasecmp(name, "local_uring")) {
+		if(!opt) return 0;
+		next_opt = extract_next(opt);
+		if(next_opt) return 0;
+
+		cfg->local_uring = atoi(opt);
+		return 1;
+	}
+	if(!strcasecmp(name, "local_multicast")) {
+		/* local_multicast <ttl> [<loop> [<interface ip>]]:
+		 * multicast groups go to the address list of "local" */
+		if(!opt) return 0;
+		next_opt = extract_next(opt);
+
+		cfg->local_mcast_ttl = atoi(opt);
+		if(next_opt) {
+			opt = next_opt;
+			next_opt = extract_next(opt);
+
+			cfg->local_mcast_loop = atoi(opt);
+		}
+		if(next_opt) {
+			opt = next_opt;
+			next_opt = extract_next(opt);
+			if(next_opt) return 0;
+
+			if(!inet_aton(opt, &in)) return 0;
+			cfg->local_mcast_if = ntohl(in.s_addr);
+		}
+		return 1;
+	}
 
 	return 0;
 }
@@ -452,6 +508,7 @@ static void add_net_entry(
 		break;
 	case QNETTYPE_QUICK_CHAT:
 	case QNETTYPE_VYPRESS_CHAT:
+	case QNETTYPE_AUTO_CHAT:
 		/* fill in broadcast list */
 		cne->broadcasts = (unsigned long*)addr;
 		break;
@@ -51,6 +51,11 @@ struct config {
 	/* hosting settings */
 	char * cfg_file_name;
 	int allow_host, daemonize, local_refresh_timeout;
+	unsigned local_tx_rate, local_tx_burst;	/* 0 - unpaced/default */
+	int local_uring;	/* local nets on io_uring, if the kernel can */
+	unsigned local_mcast_ttl;	/* 0 - kernel default */
+	int local_mcast_loop;
+	unsigned long local_mcast_if;	/* 0 - routing decides */
 	char host_if[CONFIG_MAX_HOSTNAME+1];
 	unsigned short host_port;
 
@@ -41,6 +41,10 @@
 
 #define QCROUTER_NICK	"qcRouter_msg"
 
+/* number of qcs_msg's to receive from/send to the link in one go */
+#define LOCAL_RECV_BATCH	0x10
+#define LOCAL_SEND_BATCH	0x20
+
 #define VALID_USER(uid) (!is_null_user(uid))
 
 /** structures
@@ -53,12 +57,28 @@ struct local_net_data {
 	qcs_link	link_id;
 	unsigned short	next_user_id;
 
+	/* outgoing qcs_msg's are recycled through this */
+	qcs_msgpool	msg_pool;
+
+	/* messages received with qcs_recv_batch(),
+	 * pending to be translated on next local_recv()'s */
+	qcs_msg *	rx_msgs[LOCAL_RECV_BATCH];
+	int		rx_count, rx_next;
+
 	timer_id	tm_refresh;
+
+	/* link counters, as of the last refresh */
+	qcs_stats	stats;
 };
 
 struct ref_cb_data {
 	qcs_link link_id;
-	const char * local_src;
+
+	/* REFRESH_ACK to the requestor, with src and mode filled
+	 * in from acks[], pending to be sent with qcs_send_prepared() */
+	qcs_prepared prep;
+	qcs_msg_view acks[LOCAL_SEND_BATCH];
+	int ack_count;
 };
 
 struct qmsg_parse_entry {
@@ -108,7 +128,22 @@ static struct qmsg_parse_entry entries[] = {
 	{ QCS_MSG_INVALID,		NULL			}
 };
 
+/* messages with no handler, that have src: handle_new_user()
+ * introduces their unknown senders (see local_recv_filter) */
+static const enum qcs_msgid new_user_msgs[] = {
+	QCS_MSG_CHANMEMBER_REPLY,
+	QCS_MSG_CHANMEMBER_REQUEST,
+	QCS_MSG_WATCH_CHANGE,
+	QCS_MSG_INFO_REPLY,
+	QCS_MSG_INVALID
+};
+
 static unsigned refresh_timeout_sec;
+static unsigned local_tx_rate, local_tx_burst;	/* send pacing */
+static int local_uring;		/* io_uring backend */
+static unsigned local_mcast_ttl;	/* multicast settings */
+static int local_mcast_loop;
+static unsigned long local_mcast_if;
 
 /** static routines
  *************************************/
@@ -162,7 +197,7 @@ static int handle_recv_chanlist_req(
 	qnet * net, qnet_msg * nmsg,
 	const qcs_msg * qmsg)
 {
-	qcs_msg * reply_qmsg = qcs_newmsg();
+	qcs_msg * reply_qmsg = qcs_acquiremsg(NETCONN->msg_pool);
 	chanlist_t chanlist;
 
 	assert(net && nmsg && qmsg);
@@ -176,7 +211,7 @@ static int handle_recv_chanlist_req(
 
 	qcs_send(NETCONN->link_id, reply_qmsg);
 
-	qcs_deletemsg(reply_qmsg);
+	qcs_releasemsg(NETCONN->msg_pool, reply_qmsg);
 
 	return 0;	/* don't make NETMSG */
 }
@@ -187,6 +222,13 @@ static int handle_recv_chanlist_req(
  *
  * 	refresh_req_cb(): callback for enumeration
  */
+static void refresh_req_flush(struct ref_cb_data * data)
+{
+	qcs_send_prepared(data->link_id, data->prep,
+		data->acks, data->ack_count);
+	data->ack_count = 0;
+}
+
 static void refresh_req_cb(
 		void * data, const user_id * uid,
 		enum net_umode umode,
@@ -195,17 +237,18 @@ static void refresh_req_cb(
 {
 #define REF_DATA ((struct ref_cb_data *)data)
 
-	qcs_msg * qmsg = qcs_newmsg();
+	qcs_msg_view * ack = REF_DATA->acks + REF_DATA->ack_count ++;
 
-	/* setup REFRESH_ACK msg */
-	qmsg->msg = QCS_MSG_REFRESH_ACK;
-	qcs_msgset(qmsg, QCS_SRC, nickname);
-	qcs_msgset(qmsg, QCS_DST, REF_DATA->local_src);
-	qmsg->mode = umode_to_qcs(umode);
+	/* fill in REFRESH_ACK slots: nickname stays
+	 * in the user cache, till the batch is sent */
+	ack->src.str = nickname;
+	ack->src.len = strlen(nickname);
+	ack->mode = umode_to_qcs(umode);
 
-	/* send the msg */
-	qcs_send(REF_DATA->link_id, qmsg);
-	qcs_deletemsg(qmsg);
+	/* send the batch, when it gets full */
+	if(REF_DATA->ack_count==LOCAL_SEND_BATCH) {
+		refresh_req_flush(REF_DATA);
+	}
 
 #undef REF_DATA
 }
@@ -215,9 +258,26 @@ static int handle_recv_refresh_req(
 	const qcs_msg * qmsg )
 {
 	struct ref_cb_data cb_data;
+	qcs_msg * ack_qmsg;
+
+	/* encode REFRESH_ACK to the requestor once,
+	 * every user's ack only fills in src and mode */
+	ack_qmsg = qcs_acquiremsg(NETCONN->msg_pool);
+	ack_qmsg->msg = QCS_MSG_REFRESH_ACK;
+	qcs_msgset(ack_qmsg, QCS_DST, qmsg->src);
+
+	cb_data.link_id = NETCONN->link_id;
+	cb_data.prep = qcs_newprepared(NETCONN->link_id, ack_qmsg,
+		QCS_SLOT(QCS_SRC) | QCS_SLOT_MODE);
+	qcs_releasemsg(NETCONN->msg_pool, ack_qmsg);
+	if(!cb_data.prep) {
+		log_a("net:\tcannot prepare refresh acks: ");
+		log(strerror(errno));
+		return 0;
+	}
 
-	cb_data.link_id = ((struct local_net_data*)net->conn)->link_id;
-	cb_data.local_src = qmsg->src;
+	cb_data.ack_count = 0;
+	memset(cb_data.acks, 0, sizeof(cb_data.acks));
 
 	/* do enumeration of users
 	 * altogether with ack replies
@@ -226,6 +286,11 @@ static int handle_recv_refresh_req(
 		&net->id, refresh_req_cb,
 		(void *) &cb_data
 	);
+
+	/* send what's left */
+	refresh_req_flush(&cb_data);
+
+	qcs_deleteprepared(cb_data.prep);
 	return 0;
 }
 
@@ -374,7 +439,7 @@ static int handle_recv_info_request(
 	}
 	
 	/* do reply about the user requested */
-	reply_qmsg = qcs_newmsg();
+	reply_qmsg = qcs_acquiremsg(NETCONN->msg_pool);
 
 	/* make chanlist */
 	strcpy(chanlist, usercache_chanlist_of(&dst_id));
@@ -388,7 +453,7 @@ static int handle_recv_info_request(
 	qcs_msgset(reply_qmsg, QCS_SUPP, "[masqueraded over qcRouter net]");
 	
 	qcs_send(NETCONN->link_id, reply_qmsg);
-	qcs_deletemsg(reply_qmsg);
+	qcs_releasemsg(NETCONN->msg_pool, reply_qmsg);
 
 	return 1;
 }
@@ -569,6 +634,76 @@ static int handle_recv_rename(
 	return 1;
 }
 
+/** find_parse_entry:
+ * 	returns entry of the msg handler
+ * 	(the terminating one, with proc==NULL, if none)
+ */
+static struct qmsg_parse_entry *
+find_parse_entry(enum qcs_msgid msg)
+{
+	struct qmsg_parse_entry * qpe;
+
+	for(qpe = entries; qpe->proc!=NULL; qpe ++) {
+		if(qpe->msg==msg) {
+			break;
+		}
+	}
+	return qpe;
+}
+
+/** is_foreign_nick:
+ * 	checks if nickname is ours or belongs to
+ * 	one of masqueraded users (not from this net)
+ */
+static int is_foreign_nick(qnet * net, const char * nickname)
+{
+	user_id uid;
+
+	if(eq_nickname(nickname, QCROUTER_NICK)) {
+		return 1;
+	}
+	uid = usercache_uid_of(nickname);
+	return !is_null_net(uid.net) && uid.net!=net->id;
+}
+
+/** local_recv_filter:
+ * 	drops datagrams before they get decoded (qcs_recv_filter):
+ * 	our own and masqueraded users' echoes and messages,
+ * 	that have no handler (unless they introduce a new user)
+ */
+static int local_recv_filter(const qcs_msg_peek * peek, void * net)
+{
+	if(peek->src.str!=NULL && is_foreign_nick(net, peek->src.str)) {
+		return 0;
+	}
+	if(find_parse_entry(peek->msg)->proc==NULL) {
+		/* handle_new_user() might still want it */
+		return peek->src.str!=NULL && !usercache_known(peek->src.str);
+	}
+	return 1;
+}
+
+/** local_set_msgfilter:
+ * 	makes the kernel drop messages, that have no handler
+ * 	and no src to introduce a new user with
+ */
+static int local_set_msgfilter(qcs_link link_id)
+{
+	enum qcs_msgid accepted[sizeof(entries) / sizeof(entries[0])
+		+ sizeof(new_user_msgs) / sizeof(new_user_msgs[0])];
+	int i, j;
+
+	for(i = 0; entries[i].proc!=NULL; i++) {
+		accepted[i] = entries[i].msg;
+	}
+	for(j = 0; new_user_msgs[j]!=QCS_MSG_INVALID; j++) {
+		accepted[i++] = new_user_msgs[j];
+	}
+	accepted[i] = QCS_MSG_INVALID;
+
+	return qcs_setmsgfilter(link_id, accepted);
+}
+
 /** switch_qmsg:
  * 	dispatches qcs_msg to the handler
  * 	judging by its `msg' field
@@ -585,11 +720,7 @@ static void switch_qmsg(
 	assert(net && nmsg && qmsg);
 
 	/* find msg processing routine */
-	for(qpe = entries; qpe->proc!=NULL; qpe ++) {
-		if(qpe->msg==qmsg->msg) {
-			break;
-		}
-	}
+	qpe = find_parse_entry(qmsg->msg);
 	if(qpe->proc==NULL) {
 		/* no such msg handler found: ignore */
 		nmsg->type = MSGTYPE_NULL;
@@ -619,19 +750,59 @@ static void local_reply_handshake(
 	msgq_push(NETCONN->delayed_queue, delayed);
 }
 
+/** log_refresh_stats:
+ *	logs what happened to the traffic since the last refresh,
+ *	when some users missed it: whether their REFRESH_ACKs could
+ *	have been dropped by the kernel or got lost in the net
+ */
+static void log_refresh_stats(qnet * net, unsigned dead_count)
+{
+	qcs_stats stats;
+	char * logstr;
+
+	if(!qcs_link_stats(NETCONN->link_id, &stats)) {
+		return;
+	}
+
+	if(dead_count) {
+		logstr = xalloc(256);
+		sprintf(logstr, "net:\tsince last refresh: %llu REFRESH_ACKs, "
+			"%llu datagrams dropped by kernel (rx buffer full "
+			"or filtered), %llu malformed",
+			stats.rx_msgs[QCS_MSG_REFRESH_ACK]
+				- NETCONN->stats.rx_msgs[QCS_MSG_REFRESH_ACK],
+			stats.rx_kernel_drops - NETCONN->stats.rx_kernel_drops,
+			stats.rx_malformed - NETCONN->stats.rx_malformed);
+		log(logstr);
+		xfree(logstr);
+	}
+	if(stats.tx_queue_drops!=NETCONN->stats.tx_queue_drops) {
+		logstr = xalloc(128);
+		sprintf(logstr, "net:\t%llu messages dropped since last "
+			"refresh: send queue full",
+			stats.tx_queue_drops - NETCONN->stats.tx_queue_drops);
+		log(logstr);
+		xfree(logstr);
+	}
+	NETCONN->stats = stats;
+}
+
 void handle_refresh_timeout(
 	timer_id tm,
 	int shot_nr,
 	void * net)
 {
-	qcs_msg * qmsg = qcs_newmsg();
+	qcs_msg * qmsg;
 	user_id * dead;
 	unsigned dead_count, i;
 	qnet_msg * msg;
 
 #define QNET ((qnet*)net)
+#define QCONN ((struct local_net_data*)QNET->conn)
 	assert(QNET);
 
+	qmsg = qcs_acquiremsg(QCONN->msg_pool);
+
 	debug("handle_refresh_timeout: processing any dead users..");
 
 	/* remove any who didn't care to reply us
@@ -646,8 +817,7 @@ void handle_refresh_timeout(
 			msg->src.net = QNET->id;
 			msg->d_user = dead[i];
 			
-			msgq_push(((struct local_net_data*)QNET->conn)
-					->delayed_queue, msg);
+			msgq_push(QCONN->delayed_queue, msg);
 
 			/* log the event of death */
 			log_a("net:\tlocal user \"");
@@ -656,17 +826,19 @@ void handle_refresh_timeout(
 		}
 		xfree(dead);
 	}
+	log_refresh_stats(QNET, dead_count);
 
 	/* send REFRESH_REQUEST */
 	qmsg->msg = QCS_MSG_REFRESH_REQUEST;
 	qcs_msgset(qmsg, QCS_SRC, QCROUTER_NICK);
-	qcs_send(((struct local_net_data*)QNET->conn)->link_id, qmsg);
+	qcs_send(QCONN->link_id, qmsg);
 
-	qcs_deletemsg(qmsg);
+	qcs_releasemsg(QCONN->msg_pool, qmsg);
 
 	/* and mark those users dead again ;) */
 	usercache_tag_dead_from(QNET->id);
 	
+#undef QCONN
 #undef QNET
 }
 
@@ -678,11 +850,13 @@ void handle_refresh_timeout(
  */
 static void local_destroy(qnet * net)
 {
+	int i;
+
 	assert(net);
 
-	/* destroy delayed msg, if there is one */
-	if(NETCONN->delayed_qmsg) {
-		qcs_deletemsg(NETCONN->delayed_qmsg);
+	/* destroy receive msgs (delayed msg is one of these) */
+	for(i = 0; i < LOCAL_RECV_BATCH; i++) {
+		qcs_deletemsg(NETCONN->rx_msgs[i]);
 	}
 
 	/* delete timer */
@@ -690,6 +864,7 @@ static void local_destroy(qnet * net)
 
 	/* terminate connection */
 	qcs_close(NETCONN->link_id);
+	qcs_deletemsgpool(NETCONN->msg_pool);
 
 	/* delete msg queue */
 	msgq_delete(NETCONN->delayed_queue);
@@ -710,7 +885,6 @@ static qnet_msg * local_recv(
 	int * p_more_msg_left )
 		/* (set if caller should call for another msg) */
 {
-	user_id uid;
 	qnet_msg * nmsg;
 	qcs_msg * qmsg;
 	int succ;
@@ -723,7 +897,8 @@ static qnet_msg * local_recv(
 		nmsg = msgq_pop(NETCONN->delayed_queue);
 
 		*p_more_msg_left = NETCONN->delayed_qmsg!=NULL
-				|| !msgq_empty(NETCONN->delayed_queue);
+				|| !msgq_empty(NETCONN->delayed_queue)
+				|| NETCONN->rx_next < NETCONN->rx_count;
 
 		return nmsg;
 	}
@@ -734,24 +909,36 @@ static qnet_msg * local_recv(
 	*p_more_msg_left = 0;
 
 	/* try to recv the qcs_msg:
-	 * 	either delayed or from the link */
+	 * 	either delayed, pending from previous batch
+	 * 	or from the link */
 	if(NETCONN->delayed_qmsg) {
 		qmsg = NETCONN->delayed_qmsg;
 		NETCONN->delayed_qmsg = NULL;
 	} else {
-		/* get msg from the link */
-		qmsg = qcs_newmsg();
+		if(NETCONN->rx_next==NETCONN->rx_count) {
+			/* get a batch of msgs from the link */
+			NETCONN->rx_count = NETCONN->rx_next = 0;
+
+			succ = qcs_recv_batch(NETCONN->link_id,
+					NETCONN->rx_msgs, LOCAL_RECV_BATCH,
+					&NETCONN->rx_count);
+			if(!succ) {
+				/* link failure */
+				log_a("net:\tlink receive failure for net ");
+				log_a(net_id_dump(&net->id));
+				log_a(": "); log(strerror(errno));
+				return NULL;
+			}
+		}
 
-		succ = qcs_recv(NETCONN->link_id, qmsg);
-		if(!succ && errno!=ENOMSG) {
-			/* link failure */
-			qcs_deletemsg(qmsg);
-	
-			log_a("net:\tlink receive failure for net ");
-			log_a(net_id_dump(&net->id));
-			log_a(": "); log(strerror(errno));
-			return NULL;
+		if(NETCONN->rx_next==NETCONN->rx_count) {
+			/* nothing valid in this batch */
+			nmsg = msg_new();
+			nmsg->type = MSGTYPE_NULL;
+			return nmsg;
 		}
+
+		qmsg = NETCONN->rx_msgs[NETCONN->rx_next ++];
 	}
 
 	/* ignore the msg if it came from ourselves
@@ -761,14 +948,11 @@ static qnet_msg * local_recv(
 	nmsg = msg_new();
 
 	if(qmsg->src != NULL) {
-		uid = usercache_uid_of(qmsg->src);
-
-		if(eq_nickname(qmsg->src, QCROUTER_NICK)
-			|| (!is_null_net(uid.net) && uid.net!=net->id)
-			)
-		{
-			qcs_deletemsg(qmsg);
+		/* (most of these are dropped by local_recv_filter,
+		 * but the user cache might have changed since) */
+		if(is_foreign_nick(net, qmsg->src)) {
 			nmsg->type = MSGTYPE_NULL;
+			*p_more_msg_left = NETCONN->rx_next < NETCONN->rx_count;
 			return nmsg;
 		}
 	}
@@ -783,15 +967,12 @@ static qnet_msg * local_recv(
 		switch_qmsg(net, nmsg, qmsg);
 	}
 
+	/* qmsg is owned by NETCONN->rx_msgs: it is not
+	 *	overwritten until the whole batch (and the delayed
+	 *	one) has been processed */
 	*p_more_msg_left = NETCONN->delayed_qmsg!=NULL
-		|| !msgq_empty(NETCONN->delayed_queue);
-
-	/* we should not delete the msg if it has
-	 * 	been registered as delayed one
-	 */
-	if(NETCONN->delayed_qmsg!=qmsg) {
-		qcs_deletemsg(qmsg);
-	}
+		|| !msgq_empty(NETCONN->delayed_queue)
+		|| NETCONN->rx_next < NETCONN->rx_count;
 
 	return nmsg;
 }
@@ -804,7 +985,7 @@ static void local_send(
 		qnet * net, const qnet_msg * nmsg)
 {
 	qnet_msg * delayed;
-	qcs_msg * qmsg = qcs_newmsg();
+	qcs_msg * qmsg = qcs_acquiremsg(NETCONN->msg_pool);
 
 #define SRC_NICK  usercache_nickname_of(&nmsg->src)
 #define DST_NICK  usercache_nickname_of(&nmsg->dst)
@@ -817,7 +998,7 @@ static void local_send(
 		delayed->type = MSGTYPE_NET_ENUM_ENDS;
 		msgq_push(NETCONN->delayed_queue, delayed);
 
-		qcs_deletemsg(qmsg);
+		qcs_releasemsg(NETCONN->msg_pool, qmsg);
 		return;
 			
 	case MSGTYPE_USER_ENUM_REQUEST:
@@ -828,7 +1009,7 @@ static void local_send(
 	case MSGTYPE_HANDSHAKE:
 		local_reply_handshake(net);
 		/* don't emit anything onto the net */
-		qcs_deletemsg(qmsg);
+		qcs_releasemsg(NETCONN->msg_pool, qmsg);
 		return;
 	
 	case MSGTYPE_USER_NICKCHANGE:
@@ -916,14 +1097,14 @@ static void local_send(
 		qcs_msgset(qmsg, QCS_DST, DST_NICK);
 		break;
 	default:
-		qcs_deletemsg(qmsg);
+		qcs_releasemsg(NETCONN->msg_pool, qmsg);
 		return;
 	}
 
 	/* send & release msg */
 	qcs_send(NETCONN->link_id, qmsg);
 	
-	qcs_deletemsg(qmsg);
+	qcs_releasemsg(NETCONN->msg_pool, qmsg);
 }
 
 static int local_get_prop(
@@ -937,7 +1118,21 @@ static int local_get_prop(
 		return 1;	/* we're always online */
 	
 	case QNETPROP_RX_SOCKET:
-		qcs_rxsocket(NETCONN->link_id, &sock);
+		/* the io_uring, if the link is on one */
+		qcs_rxpollfd(NETCONN->link_id, &sock);
+		return sock;
+
+	case QNETPROP_TX_TIMER:
+		/* -1, unless the link is paced */
+		qcs_txtimer(NETCONN->link_id, &sock);
+		return sock;
+
+	case QNETPROP_TX_SOCKET:
+		qcs_txsocket(NETCONN->link_id, &sock);
+		return sock;
+
+	case QNETPROP_TX_BLOCKED:
+		qcs_txqueue(NETCONN->link_id, NULL, &sock);
 		return sock;
 
 	case QNETPROP_DAMAGED:
@@ -946,6 +1141,15 @@ static int local_get_prop(
 	return 0;
 }
 
+/** local_flush:
+ *	sends what the link has queued, as its rate allows
+ *	and its tx socket takes
+ */
+static void local_flush(qnet * net)
+{
+	qcs_flush(NETCONN->link_id);
+}
+
 static int local_set_prop(
 		qnet * net,
 		enum qnet_property property, int value)
@@ -965,10 +1169,13 @@ qnet * local_connect(
 	static const unsigned long default_broadcast[] = { 0xffffffffUL, 0 };
 	qnet * net;
 	qcs_link link_id;
+	qcs_link_opts opts;
 	unsigned long * addr;
 	char * logstr = xalloc(512);
+	int i;
 
-	assert(type==QNETTYPE_VYPRESS_CHAT || type==QNETTYPE_QUICK_CHAT);
+	assert(type==QNETTYPE_VYPRESS_CHAT || type==QNETTYPE_QUICK_CHAT
+		|| type==QNETTYPE_AUTO_CHAT);
 
 	/* set broadcast to 255.255.255.255, if not specified */
 	if(broadcast_addr==NULL) {
@@ -985,12 +1192,24 @@ qnet * local_connect(
 	log(".");
 	xfree(logstr);
 
-	/* setup connection */	
-	link_id = qcs_open(
-		type==QNETTYPE_QUICK_CHAT
-			? QCS_PROTO_QCHAT:
-			QCS_PROTO_VYPRESS ,
-		broadcast_addr, port
+	/* setup connection: paced, if asked to, so that bursts
+	 * (replies to REFRESH_REQUEST, etc) don't overrun the segment,
+	 * and non-blocking: a congested segment must not stall us */
+	qcs_initopts(&opts);
+	opts.tx_nonblock = 1;
+	opts.tx_rate = local_tx_rate;
+	if(local_tx_burst) {
+		opts.tx_burst = local_tx_burst;
+	}
+	opts.backend = local_uring ? QCS_BACKEND_URING: QCS_BACKEND_SOCKETS;
+	opts.mcast_ttl = local_mcast_ttl;
+	opts.mcast_loop = local_mcast_loop;
+	opts.mcast_if = local_mcast_if;
+	link_id = qcs_open_ex(
+		type==QNETTYPE_QUICK_CHAT ? QCS_PROTO_QCHAT
+			: type==QNETTYPE_AUTO_CHAT ? QCS_PROTO_AUTO
+			: QCS_PROTO_VYPRESS,
+		broadcast_addr, port, &opts
 	);
 	if(link_id==NULL) {
 		/* failed.. */
@@ -999,15 +1218,47 @@ qnet * local_connect(
 
 		return NULL;
 	}
+	if(local_uring && qcs_backend(link_id, &i)
+		&& i!=QCS_BACKEND_URING)
+	{
+		log("net:	io_uring not available, using plain sockets");
+	}
 
 	net = xalloc(sizeof(qnet));
 	
 	/* setup qnet struct */
 	net->conn = xalloc(sizeof(struct local_net_data));
 	NETCONN->link_id = link_id;
+
+	/* enough msgs for a message and a reply (refresh acks
+	 * are sent as views of a prepared message) */
+	NETCONN->msg_pool = qcs_newmsgpool(2);
+	if(NETCONN->msg_pool==NULL) {
+		log_a("net:	local net connection failed: ");
+		log(strerror(errno));
+
+		qcs_close(link_id);
+		xfree(net->conn);
+		xfree(net);
+		return NULL;
+	}
+	/* skip decoding of what local_recv() would ignore anyway,
+	 * and don't even receive what has no handler */
+	qcs_setrecvfilter(link_id, local_recv_filter, net);
+	if(!local_set_msgfilter(link_id)) {
+		log_a("net:	kernel message filter not set: ");
+		log(strerror(errno));
+	}
+
 	NETCONN->delayed_qmsg = NULL;
 	NETCONN->next_user_id = 0;
 	NETCONN->delayed_queue = msgq_new();
+	memset(&NETCONN->stats, 0, sizeof(qcs_stats));
+
+	for(i = 0; i < LOCAL_RECV_BATCH; i++) {
+		NETCONN->rx_msgs[i] = qcs_newmsg();
+	}
+	NETCONN->rx_count = NETCONN->rx_next = 0;
 
 	net->type = type;
 
@@ -1017,6 +1268,7 @@ qnet * local_connect(
 	net->recv = local_recv;
 	net->get_prop = local_get_prop;
 	net->set_prop = local_set_prop;
+	net->flush = local_flush;
 
 	/* setup refresh timer for this net */
 	NETCONN->tm_refresh = timer_start(
@@ -1026,16 +1278,33 @@ qnet * local_connect(
 	return net;
 }
 
-void localconn_init(unsigned refresh_timeout)
+void localconn_init(
+	unsigned refresh_timeout,
+	unsigned tx_rate, unsigned tx_burst,
+	int uring,
+	unsigned mcast_ttl, int mcast_loop, unsigned long mcast_if)
 {
 #ifndef NDEBUG
 	char dbg[128];
 	sprintf(dbg, "local_refresh_timeout = %dsecs", refresh_timeout);
 	debug(dbg);
+	sprintf(dbg, "local_tx_rate = %u/sec, burst %u", tx_rate, tx_burst);
+	debug(dbg);
+	sprintf(dbg, "local_uring = %d", uring);
+	debug(dbg);
+	sprintf(dbg, "local_multicast = ttl %u, loop %d, if 0x%08lx",
+		mcast_ttl, mcast_loop, mcast_if);
+	debug(dbg);
 #endif
 
 	refresh_timeout_sec =
 		refresh_timeout ? refresh_timeout: 1;
+	local_tx_rate = tx_rate;
+	local_tx_burst = tx_burst;
+	local_uring = uring;
+	local_mcast_ttl = mcast_ttl;
+	local_mcast_loop = mcast_loop;
+	local_mcast_if = mcast_if;
 }
 
 void localconn_exit()
@@ -31,7 +31,9 @@ qnet * local_connect(
 	unsigned short port,
 	enum qnet_type);
 
-void localconn_init(unsigned refresh_timeout);
+void localconn_init(unsigned refresh_timeout,
+	unsigned tx_rate, unsigned tx_burst, int uring,
+	unsigned mcast_ttl, int mcast_loop, unsigned long mcast_if);
 void localconn_exit();
  
 #endif	/* #ifndef LOCALNET_H__ */
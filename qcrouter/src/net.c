@@ -290,10 +290,13 @@ void net_init(const struct config * cfg)
 	local->recv = NULL;
 	local->get_prop = NULL;
 	local->set_prop = NULL;
+	local->flush = NULL;
 
 	/* init local_net & router_net subsystems
 	 */
-	localconn_init(cfg->local_refresh_timeout);
+	localconn_init(cfg->local_refresh_timeout,
+		cfg->local_tx_rate, cfg->local_tx_burst, cfg->local_uring,
+		cfg->local_mcast_ttl, cfg->local_mcast_loop, cfg->local_mcast_if);
 }
 
 /** net_exit:
@@ -370,6 +373,15 @@ qnet * net_connect(
 		le->net = local_connect(addr, port, type);
 		break;
 
+	case QNETTYPE_AUTO_CHAT:
+		sprintf(buf, "net:\tconnecting to QCHAT & VYCHAT on port %hu..",
+			port);
+		log(buf);
+
+		/* both protocols on one local broadcast net connection */
+		le->net = local_connect(addr, port, type);
+		break;
+
 	case QNETTYPE_ROUTER:
 		sprintf(buf, "net:\tconnecting to qcRouter %s:%hu..",
 			(const char*)addr, port);
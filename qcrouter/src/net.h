@@ -30,6 +30,7 @@
 enum qnet_type {
 	QNETTYPE_QUICK_CHAT,
 	QNETTYPE_VYPRESS_CHAT,
+	QNETTYPE_AUTO_CHAT,	/* qchat & vypress chat on the same port */
 	QNETTYPE_ROUTER,
 	QNETTYPE_PLUGIN,
 
@@ -41,7 +42,10 @@ enum qnet_property {
 	QNETPROP_ONLINE,
 	QNETPROP_RX_SOCKET,
 	QNETPROP_RX_PENDING,
-	QNETPROP_DAMAGED
+	QNETPROP_DAMAGED,
+	QNETPROP_TX_TIMER,	/* fd, readable when flush is due (or -1) */
+	QNETPROP_TX_SOCKET,	/* fd, to flush on POLLOUT (or -1) */
+	QNETPROP_TX_BLOCKED	/* output waits for TX_SOCKET POLLOUT */
 };
 
 typedef struct qnet_struct {
@@ -56,6 +60,9 @@ typedef struct qnet_struct {
 	qnet_msg * (*recv)(struct qnet_struct *, int *);
 	int (*get_prop)(struct qnet_struct *, enum qnet_property);
 	int (*set_prop)(struct qnet_struct *, enum qnet_property, int);
+
+	/* sends output queued by the net (NULL, if it queues none) */
+	void (*flush)(struct qnet_struct *);
 } qnet;
 
 #define QNET_SEND(n, m) n->send(n, m)
@@ -615,6 +615,7 @@ qnet * plugin_open(const char * filename)
 	net->recv = plugin_recv;
 	net->get_prop = plugin_get_prop;
 	net->set_prop = plugin_set_prop;
+	net->flush = NULL;
 
 	/* initialize script */
 	active_net = net;
@@ -708,6 +709,12 @@ plugin_get_prop(
 	case QNETPROP_DAMAGED:
 		/* supposedly never damaged */
 		return 0;
+	case QNETPROP_TX_TIMER:
+	case QNETPROP_TX_SOCKET:
+		/* plugin output is never queued */
+		return -1;
+	case QNETPROP_TX_BLOCKED:
+		return 0;
 	}
 	return 0;
 }
@@ -0,0 +1,528 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	schema driven message encoder/decoder
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <linux/filter.h>
+
+#include "qcs_link.h"
+#include "qcs_schema.h"
+#include "supp.h"
+#include "link.h"
+#include "codec.h"
+
+#define ADDCHAR(ch) do{\
+	if(*pmsg_len==cap){errno=EMSGSIZE;return 0;}	\
+	msg_buf[(*pmsg_len)++]=(ch);}while(0)
+#define ADDSTR(s) do{\
+	if(s==NULL){errno=ENOMSG;return 0;}	\
+	slen=strlen(s)+1;				\
+	if(slen > cap-*pmsg_len){errno=EMSGSIZE;return 0;}	\
+	memcpy(msg_buf+*pmsg_len,(s),slen);		\
+	*pmsg_len+=slen;				\
+	}while(0)
+#define ADDVIEW(v) do{\
+	if((v).str==NULL){errno=ENOMSG;return 0;}	\
+	if((size_t)(v).len >= cap-*pmsg_len){errno=EMSGSIZE;return 0;}	\
+	memcpy(msg_buf+*pmsg_len,(v).str,(v).len);	\
+	*pmsg_len+=(v).len;				\
+	msg_buf[(*pmsg_len)++]='\0';			\
+	}while(0)
+
+/* ADDSLOT:
+ *	records slot of the prepared message at the current offset */
+#define ADDSLOT(code) do{\
+	assert(*p_count < QCS_PREPARED_SLOTS);		\
+	slots[*p_count].offset=*pmsg_len;		\
+	slots[(*p_count)++].field=(code);		\
+	}while(0)
+/* ADDFIELD:
+ *	string field, or an empty one for the slot, if it is in mask */
+#define ADDFIELD(code, v, textid) do{\
+	if(mask & QCS_SLOT(textid)){ADDSLOT(code);ADDCHAR('\0');}	\
+	else ADDVIEW(v);				\
+	}while(0)
+
+/* encode_layout:
+ *	encodes msg with the layout of codec; the fields in mask
+ *	(QCS_SLOT_*) are left out and recorded in slots instead */
+static int encode_layout(
+	const struct qcs__codec * codec,
+	const qcs_msg_view * msg,
+	unsigned int mask,
+	struct qcs__slot * slots, int * p_count,
+	char * msg_buf, size_t cap,
+	size_t * pmsg_len )
+{
+	const struct qcs__layout * layout;
+	const char * field, * konst;
+	size_t slen;
+
+	*pmsg_len = 0;
+
+	if((unsigned int)msg->msg >= QCS_SCHEMA_MSGS
+		|| codec->layouts[msg->msg].opcode==0)
+	{
+		errno = ENOMSG;
+		return 0;
+	}
+	layout = codec->layouts + msg->msg;
+	konst = layout->consts;
+
+	ADDCHAR(layout->opcode);
+	if(layout->subcode) {
+		ADDCHAR(layout->subcode);
+	}
+
+	for(field = layout->fields; *field; field++) {
+		switch(*field) {
+		case 's': ADDFIELD('s', msg->src, QCS_SRC);	break;
+		case 'd': ADDFIELD('d', msg->dst, QCS_DST);	break;
+		case 't': ADDFIELD('t', msg->text, QCS_TEXT);	break;
+		case 'p': ADDFIELD('p', msg->supp, QCS_SUPP);	break;
+		case 'c': ADDFIELD('c', msg->chan, QCS_CHAN);	break;
+		case '#':
+			ADDCHAR('#');
+			ADDFIELD('c', msg->chan, QCS_CHAN);
+			break;
+		case 'm':
+			if(mask & QCS_SLOT_MODE) {
+				ADDSLOT('m');
+				ADDCHAR('0');
+				break;
+			}
+			ADDCHAR(qcs__net_qcmode(msg->mode));
+			break;
+		case 'w':
+		case 'W':
+			if(mask & QCS_SLOT_MODE) {
+				ADDSLOT('w');
+				ADDCHAR('0');
+				break;
+			}
+			ADDCHAR(qcs__net_qcwatch(msg->mode));
+			break;
+		case '0':
+		case '_':
+			ADDCHAR('0');
+			break;
+		case 'k':
+			ADDSTR(konst);
+			konst += slen;
+			break;
+		case 'M':
+			if(mask & QCS_SLOT(QCS_CHAN)) {
+				/* checked, when filled in */
+				ADDSLOT('M');
+				break;
+			}
+			if(msg->chan.str==NULL || msg->chan.len!=4
+				|| strncasecmp(msg->chan.str, "Main", 4))
+			{
+				errno = ENOMSG;
+				return 0;
+			}
+			break;
+		default:
+			assert(0);
+		}
+	}
+
+	return 1;
+}
+
+int qcs__encode_msg(
+	const struct qcs__codec * codec,
+	const qcs_msg_view * msg,
+	char * msg_buf, size_t cap,
+	size_t * pmsg_len )
+{
+	assert(codec && msg && msg_buf && pmsg_len);
+
+	return encode_layout(codec, msg, 0, NULL, NULL,
+		msg_buf, cap, pmsg_len);
+}
+
+int qcs__prepare_msg(
+	const struct qcs__codec * codec,
+	const qcs_msg_view * msg,
+	unsigned int mask,
+	struct qcs__slot * slots, int * p_count,
+	char * msg_buf, size_t cap,
+	size_t * pmsg_len )
+{
+	assert(codec && msg && slots && p_count && msg_buf && pmsg_len);
+
+	*p_count = 0;
+	return encode_layout(codec, msg, mask, slots, p_count,
+		msg_buf, cap, pmsg_len);
+}
+
+/* PUTCHUNK:
+ *	copies len bytes of s (no terminator added) */
+#define PUTCHUNK(s, len) do{\
+	if((size_t)(len) > cap-*pmsg_len){errno=EMSGSIZE;return 0;}	\
+	memcpy(msg_buf+*pmsg_len,(s),(len));		\
+	*pmsg_len+=(len);				\
+	}while(0)
+#define PUTVIEW(v) do{\
+	if((v).str==NULL){errno=ENOMSG;return 0;}	\
+	PUTCHUNK((v).str,(v).len);			\
+	}while(0)
+
+int qcs__patch_msg(
+	const char * tmpl, size_t tmpl_len,
+	const struct qcs__slot * slots, int count,
+	const qcs_msg_view * msg,
+	char * msg_buf, size_t cap,
+	size_t * pmsg_len )
+{
+	size_t from = 0;
+	int i;
+
+	assert(tmpl && (slots || !count) && msg && msg_buf && pmsg_len);
+
+	*pmsg_len = 0;
+	for(i = 0; i < count; i++) {
+		/* the template up to the slot */
+		PUTCHUNK(tmpl + from, slots[i].offset - from);
+		from = slots[i].offset;
+
+		/* a string goes in front of the '\0' the template has
+		 * for it, a mode char takes the place of the one there */
+		switch(slots[i].field) {
+		case 's': PUTVIEW(msg->src);	break;
+		case 'd': PUTVIEW(msg->dst);	break;
+		case 't': PUTVIEW(msg->text);	break;
+		case 'p': PUTVIEW(msg->supp);	break;
+		case 'c': PUTVIEW(msg->chan);	break;
+		case 'm':
+			ADDCHAR(qcs__net_qcmode(msg->mode));
+			from ++;
+			break;
+		case 'w':
+			ADDCHAR(qcs__net_qcwatch(msg->mode));
+			from ++;
+			break;
+		case 'M':
+			if(msg->chan.str==NULL || msg->chan.len!=4
+				|| strncasecmp(msg->chan.str, "Main", 4))
+			{
+				errno = ENOMSG;
+				return 0;
+			}
+			break;
+		default:
+			assert(0);
+		}
+	}
+	PUTCHUNK(tmpl + from, tmpl_len - from);
+
+	return 1;
+}
+
+/* lookup_msgid:
+ *	looks up message id by opcode (and subcode), sets *p_pos
+ *	past them
+ * returns:
+ *	QCS_MSG_INVALID, if the message is unknown	*/
+static enum qcs_msgid lookup_msgid(
+	const struct qcs__codec * codec,
+	const char * pmsg, int pmsg_len,
+	int * p_pos )
+{
+	unsigned int op, sub;
+
+	if(pmsg_len < 1) {
+		return QCS_MSG_INVALID;
+	}
+	op = (unsigned char)pmsg[0];
+	if(op >= QCS_CODEC_OPCODES) {
+		return QCS_MSG_INVALID;
+	}
+	*p_pos = 1;
+	if(codec->msgids[op][0]!=QCS_MSG_INVALID) {
+		return codec->msgids[op][0];
+	}
+
+	if(pmsg_len < 2) {
+		return QCS_MSG_INVALID;
+	}
+	sub = (unsigned char)(pmsg[1] - '0');
+	if(sub >= QCS_SCHEMA_SUBCODES) {
+		return QCS_MSG_INVALID;
+	}
+	*p_pos = 2;
+	return codec->msgids[op][1 + sub];
+}
+
+#define GETCHAR(c) do {\
+	if(pos==pmsg_len){errno=ENOMSG; return 0;}	\
+	(c)=pmsg[pos++];\
+	}while(0)
+#define NEXTNUL() do {\
+	while(next < nuls && offs[next] < pos) next++;	\
+	if(next==nuls){errno=ENOMSG;return 0;}	\
+	}while(0)
+#define GETSTR(v) do {\
+	NEXTNUL();					\
+	(v).str=pmsg+pos;(v).len=offs[next]-pos;	\
+	pos=offs[next++]+1;				\
+	}while(0)
+#define SKIPSTR() do {\
+	NEXTNUL();					\
+	pos=offs[next++]+1;				\
+	}while(0)
+
+int qcs__decode_msg(
+	const struct qcs__codec * codec,
+	const char * pmsg, int pmsg_len,
+	qcs_msg_view * msg )
+{
+	unsigned short offs[QCP_MAXUDPSIZE];
+	int pos = 0, nuls, next = 0;
+	const char * field;
+	char ch;
+
+	assert( codec && pmsg && msg );
+
+	memset(msg, 0, sizeof(qcs_msg_view));
+	msg->msg = QCS_MSG_INVALID;
+	msg->mode = QCS_UMODE_INVALID;
+
+	msg->msg = lookup_msgid(codec, pmsg, pmsg_len, &pos);
+	if(msg->msg==QCS_MSG_INVALID) {
+		errno = ENOMSG;
+		return 0;
+	}
+
+	/* find all the field terminators in one pass */
+	if(pmsg_len > QCP_MAXUDPSIZE) {
+		errno = ENOMSG;
+		return 0;
+	}
+	nuls = qcs__index_fields(pmsg, pmsg_len, offs);
+
+	for(field = codec->layouts[msg->msg].fields; *field; field++) {
+		switch(*field) {
+		case 's': GETSTR(msg->src);	break;
+		case 'd': GETSTR(msg->dst);	break;
+		case 't': GETSTR(msg->text);	break;
+		case 'p': GETSTR(msg->supp);	break;
+		case 'c': GETSTR(msg->chan);	break;
+		case '#':
+			GETCHAR(ch);
+			if(ch!='#') {
+				errno = ENOMSG;
+				return 0;
+			}
+			GETSTR(msg->chan);
+			break;
+		case 'm':
+			GETCHAR(ch);
+			msg->mode = qcs__local_qcmode(ch);
+			if(msg->mode==QCS_UMODE_INVALID) {
+				errno = ENOMSG;
+				return 0;
+			}
+			break;
+		case 'W':
+			if(pos==pmsg_len) {
+				/* watch flag is not sent by qc < 1.6 */
+				break;
+			}
+			/* fall through */
+		case 'w':
+			GETCHAR(ch);
+			msg->mode |= qcs__local_qcwatch(ch);
+			break;
+		case '0':
+			GETCHAR(ch);
+			break;
+		case '_':
+			break;
+		case 'k':
+			SKIPSTR();
+			break;
+		case 'M':
+			/* "Main" is implied */
+			msg->chan.str = "Main";
+			msg->chan.len = 4;
+			break;
+		default:
+			assert(0);
+		}
+	}
+	return 1;
+}
+
+int qcs__peek_msg(
+	const struct qcs__codec * codec,
+	const char * pmsg, int pmsg_len,
+	qcs_msg_peek * peek )
+{
+	const char * field, * nul;
+	int pos = 0;
+
+	assert( codec && pmsg && peek );
+
+	peek->src.str = NULL;
+	peek->src.len = 0;
+
+	peek->msg = lookup_msgid(codec, pmsg, pmsg_len, &pos);
+	if(peek->msg==QCS_MSG_INVALID) {
+		errno = ENOMSG;
+		return 0;
+	}
+
+	/* skip whatever goes in front of src: the body
+	 * is not validated, that is up to qcs__decode_msg() */
+	for(field = codec->layouts[peek->msg].fields; *field; field++) {
+		switch(*field) {
+		case 'm':
+		case 'w':
+		case 'W':
+		case '0':
+			pos ++;
+			break;
+		case '#':
+			/* chan name follows '#' */
+			pos ++;
+			/* fall through */
+		case 's':
+		case 'd':
+		case 't':
+		case 'p':
+		case 'c':
+		case 'k':
+			nul = pos < pmsg_len
+				? memchr(pmsg + pos, '\0', pmsg_len - pos): NULL;
+			if(nul==NULL) {
+				errno = ENOMSG;
+				return 0;
+			}
+			if(*field=='s') {
+				peek->src.str = pmsg + pos;
+				peek->src.len = nul - (pmsg + pos);
+				return 1;
+			}
+			pos = nul - pmsg + 1;
+			break;
+		case '_':
+		case 'M':
+			break;
+		default:
+			assert(0);
+		}
+	}
+
+	/* message has no src */
+	return 1;
+}
+
+/* EMIT:
+ *	appends BPF instruction to prog (room is checked up front) */
+#define EMIT(insn) (prog[len++] = (struct sock_filter)insn)
+
+int qcs__compile_msgfilter(
+	const struct qcs__codec * codec,
+	const enum qcs_msgid * accepted,
+	unsigned int offset,
+	struct sock_filter * prog, int max )
+{
+	unsigned char want[QCS_CODEC_OPCODES][QCS_SCHEMA_SUBCODES + 1];
+	int to_accept[QCS_MSGFILTER_MAX], to_sub[QCS_CODEC_OPCODES];
+	int len = 0, n_accept = 0, op, sub, i;
+	const struct qcs__layout * layout;
+
+	assert( codec && accepted && prog );
+
+	if(max < QCS_MSGFILTER_MAX) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* (opcode, subcode) pairs to let through */
+	memset(want, 0, sizeof(want));
+	for(; *accepted!=QCS_MSG_INVALID; accepted++) {
+		if((unsigned int)*accepted >= QCS_SCHEMA_MSGS
+			|| codec->layouts[*accepted].opcode==0)
+		{
+			errno = EINVAL;
+			return 0;
+		}
+		layout = codec->layouts + *accepted;
+		want[(int)layout->opcode][layout->subcode
+			? 1 + layout->subcode - '0': 0] = 1;
+	}
+
+	/* opcode: accept or jump to its subcode block */
+	EMIT(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offset));
+	for(op = 0; op < QCS_CODEC_OPCODES; op++) {
+		to_sub[op] = -1;
+		if(want[op][0]) {
+			to_accept[n_accept++] = len;
+			EMIT(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, op, 0, 0));
+			continue;
+		}
+		for(sub = 0; sub < QCS_SCHEMA_SUBCODES; sub++) {
+			if(want[op][1 + sub]) {
+				to_sub[op] = len;
+				EMIT(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, op, 0, 0));
+				break;
+			}
+		}
+	}
+	EMIT(BPF_STMT(BPF_RET | BPF_K, 0));
+
+	/* subcode blocks */
+	for(op = 0; op < QCS_CODEC_OPCODES; op++) {
+		if(to_sub[op] < 0) {
+			continue;
+		}
+		prog[to_sub[op]].jt = len - to_sub[op] - 1;
+
+		EMIT(BPF_STMT(BPF_LD | BPF_B | BPF_ABS, offset + 1));
+		for(sub = 0; sub < QCS_SCHEMA_SUBCODES; sub++) {
+			if(want[op][1 + sub]) {
+				to_accept[n_accept++] = len;
+				EMIT(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+					'0' + sub, 0, 0));
+			}
+		}
+		EMIT(BPF_STMT(BPF_RET | BPF_K, 0));
+	}
+
+	/* accept: keep the whole datagram */
+	for(i = 0; i < n_accept; i++) {
+		prog[to_accept[i]].jt = len - to_accept[i] - 1;
+	}
+	EMIT(BPF_STMT(BPF_RET | BPF_K, 0xffffffff));
+
+	assert(len <= QCS_MSGFILTER_MAX && len - 1 <= 0xff);
+	return len;
+}
@@ -0,0 +1,89 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	schema driven message encoder/decoder
+ */
+
+#ifndef CODEC_H
+#define CODEC_H
+
+/* qcs__layout:
+ *	wire layout of a message, as given by the schema */
+struct qcs__layout {
+	char opcode;		/* first byte (0 - not in the protocol) */
+	char subcode;		/* second byte (0 - none) */
+	const char * fields;	/* QCS_F_* codes */
+	const char * consts;	/* strings for QCS_F_CONST fields */
+};
+
+/* qcs__codec:
+ *	protocol tables, generated from the schema with
+ *	QCS_CODEC_LAYOUT and QCS_CODEC_MSGID
+ */
+struct qcs__codec {
+	const struct qcs__layout * layouts;
+		/* QCS_SCHEMA_MSGS entries, by message id */
+	const unsigned char (* msgids)[QCS_SCHEMA_SUBCODES + 1];
+		/* 0x80 entries, by opcode: message id at [0] or,
+		 * for messages with subcode, at [1 + subcode-'0'] */
+};
+
+#define QCS_CODEC_OPCODES	0x80
+
+#define QCS_CODEC_LAYOUT(id, op, sub, fields, consts) \
+	[QCS_MSG_##id] = { (op), (sub), (fields), (consts) },
+#define QCS_CODEC_MSGID(id, op, sub, fields, consts) \
+	[(op)][(sub) ? 1 + (sub) - '0': 0] = QCS_MSG_##id,
+
+/* max length of BPF program by qcs__compile_msgfilter():
+ *	a load and two returns, plus up to three instructions
+ *	per message */
+#define QCS_MSGFILTER_MAX	(QCS_SCHEMA_MSGS * 3 + 3)
+
+/* qcs__slot:
+ *	field of a prepared message, filled in per send: goes in at
+ *	offset of the template (a mode char replaces the one there) */
+struct qcs__slot {
+	unsigned short offset;
+	char field;		/* 's', 'd', 't', 'p', 'c', 'm', 'w', 'M' */
+};
+
+/* max slots of a prepared message: more, than a layout has fields */
+#define QCS_PREPARED_SLOTS	8
+
+struct sock_filter;
+
+int qcs__encode_msg(const struct qcs__codec *,
+		const qcs_msg_view *, char *, size_t, size_t *);
+int qcs__prepare_msg(const struct qcs__codec *,
+		const qcs_msg_view *, unsigned int,
+		struct qcs__slot *, int *, char *, size_t, size_t *);
+int qcs__patch_msg(const char *, size_t, const struct qcs__slot *, int,
+		const qcs_msg_view *, char *, size_t, size_t *);
+int qcs__decode_msg(const struct qcs__codec *,
+		const char *, int, qcs_msg_view *);
+int qcs__peek_msg(const struct qcs__codec *,
+		const char *, int, qcs_msg_peek *);
+int qcs__compile_msgfilter(const struct qcs__codec *,
+		const enum qcs_msgid *, unsigned int,
+		struct sock_filter *, int);
+
+#endif	/* CODEC_H */
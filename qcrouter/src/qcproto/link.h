@@ -29,16 +29,163 @@
 
 #define QCP_MAXUDPSIZE	0x200
 
+/* max size of outgoing datagram: message plus
+ * vypress chat signature, that goes in front of it */
+#define QCP_MAXDGRAMSIZE	(QCP_MAXUDPSIZE + 10)
+
+/* default number of signatures in vypress duplicate cache */
+#define QCS_DUP_CACHE_SIZE	0x100
+
+/* max number of datagrams, that qcs_recv_batch() will drain
+ * with a single recvmmsg() call */
+#define QCS_RECV_BATCH	0x20
+
+/* number of receive buffers of a QCS_BACKEND_URING link, that
+ * multishot recvmsg fills in, before they are received from */
+#define QCS_URING_RX_BUFS	0x100
+
+/* min number of (datagram x broadcast address) pairs, that
+ * qcs_send_batch() will push with a single sendmmsg() call */
+#define QCS_SEND_BATCH	0x40
+
+/* defaults for paced links: datagrams sent back to back
+ * and messages queued (see qcs_link_opts) */
+#define QCS_TX_BURST	0x10
+#define QCS_TX_QUEUE	0x400
+
+/* number of entries in the table of nicknames, that a QCS_PROTO_AUTO
+ * link remembers the protocol of (power of 2) */
+#define QCS_PEER_TABLE	0x400
+
+/* max number of ready links, that qcs_linkset_wait() will
+ * fetch with a single epoll_wait() call */
+#define QCS_LINKSET_EVENTS	0x40
+
+/* number of datagrams a QCS_BACKEND_SEGMENT link
+ * queues up, before the rest are dropped */
+#define QCS_SEGMENT_QUEUE	0x100
+
+struct mmsghdr;
+struct link_data_struct;
+
+/* qcs__transport:
+ *	datagram I/O of a link, as recvmmsg()/sendmmsg() do it:
+ *	over UDP sockets or an in-process segment (the io_uring
+ *	rings of QCS_BACKEND_URING links are driven apart)	*/
+struct qcs__transport {
+	int (* recv)(struct link_data_struct *, struct mmsghdr *,
+		unsigned int, int);
+	int (* send)(struct link_data_struct *, struct mmsghdr *,
+		unsigned int);
+};
+
 /* qcslink
  *	defines state of a link */
 typedef struct link_data_struct {
 	int rx, tx;             /* rx. tx socket ids    */
+	const struct qcs__transport * transport;
+	struct qcs__seg_host * seg_host;
+		/* QCS_BACKEND_SEGMENT: the link on its segment, rx is
+		 * its eventfd and there is no tx socket	*/
 	unsigned short port;    /* link port            */
 	unsigned long * broadcasts;
 		/* list of broadcast addresses in host byte order	*/
 	unsigned int broadcast_count;
+	unsigned long mcast_if;
+		/* interface multicast groups are joined on
+		 * (network byte order, INADDR_ANY - routing decides)	*/
 
-	int mode;		/* mode of the link (Qchat/vypress) */
+	int mode;		/* mode of the link (Qchat/vypress/auto) */
+	unsigned int * peers;
+		/* QCS_PROTO_AUTO link: QCS_PEER_TABLE entries, each
+		 * a nickname hash with the protocol in its low bit
+		 * (0 - empty), written by the sub-links as well */
+
+	/* receive buffers, reused on every qcs_recv/qcs_recv_batch:
+	 *	QCS_RECV_BATCH slots of QCP_MAXUDPSIZE bytes each */
+	char * rx_buf;
+	struct mmsghdr * rx_hdrs;
+	struct iovec * rx_iovs;
+	struct sockaddr_in * rx_addrs;
+	char * rx_ctrl;		/* receive time & destination */
+
+	/* io_uring backend (NULL rings - plain sockets): rx ring receives
+	 *	with multishot recvmsg into its own buffers, tx ring sends
+	 *	tx_hdrs as chains of linked sendmsg's */
+	struct qcs__uring * rx_ring, * tx_ring;
+	struct msghdr * rx_ring_msg;	/* recvmsg template */
+	int rx_armed;		/* recvmsg is delivering datagrams */
+	unsigned short rx_held[QCS_RECV_BATCH];
+		/* buffers of the datagrams received last, given
+		 * back to the kernel on the next receive */
+	unsigned int rx_held_count;
+	unsigned int tx_chain;	/* sequence number of the last chain */
+
+	/* send state: broadcast destinations and sendmmsg()
+	 *	vectors, tx_slots entries each */
+	struct sockaddr_in * tx_addrs;	/* broadcast_count entries */
+	struct mmsghdr * tx_hdrs;
+	struct iovec * tx_iovs;
+	char * tx_buf;		/* datagrams of the batch: tx_slots
+				 * slots of QCP_MAXDGRAMSIZE bytes */
+	size_t * tx_lens;
+	enum qcs_msgid * tx_ids;	/* message of each slot */
+	unsigned char * tx_more;	/* the next slot holds the same
+					 * message (QCS_PROTO_AUTO) */
+
+	/* send pacing: token bucket, kept as the time the next
+	 *	datagram is due at (GCRA), all in CLOCK_MONOTONIC ns */
+	unsigned long long tx_interval;	/* per datagram, 0 - unpaced */
+	unsigned long long tx_tolerance;	/* burst allowance */
+	unsigned long long tx_due;
+	unsigned long long tx_armed;	/* timer expiry, 0 - disarmed */
+	int tx_timer;		/* timerfd, -1 if unpaced */
+	int tx_nonblock;	/* tx socket is O_NONBLOCK */
+	int tx_blocked;		/* ... and its buffer is full */
+
+	/* send queue of a paced or non-blocking link: ring of txq_size
+	 *	encoded messages, head one sent to broadcasts from
+	 *	txq_bcast on */
+	char * txq_buf;		/* QCP_MAXDGRAMSIZE bytes per slot */
+	size_t * txq_lens;
+	enum qcs_msgid * txq_ids;
+	unsigned char * txq_more;	/* as tx_more */
+	unsigned int txq_size, txq_head, txq_count;
+	unsigned int txq_bcast;
+	int txq_sent;		/* head message went to some broadcast
+				 * address (any of its datagrams) */
+	unsigned int tx_slots;
+
+	/* vypress chat duplicate detection & signature generator */
+	struct qcs__dup_cache dup;
+	unsigned int sig_seed;
+
+	struct qcs__filter filter;	/* see qcs_setrecvfilter() */
+
+	/* traffic counters (but rx_duplicates & rx_filtered,
+	 *	counted by dup & filter), see qcs_link_stats() */
+	qcs_stats stats;
+
+	/* SO_REUSEPORT fan-out: sub-link fanout_index of fanout_count
+	 *	(the link itself is #0 and owns the rest, see qcs_sublink) */
+	struct link_data_struct * parent;	/* NULL for the link */
+	struct link_data_struct ** subs;	/* fanout_count-1 entries */
+	unsigned int fanout_index, fanout_count;
+	int fanout_cpu;		/* spread by CPU, not by sender */
 } link_data;
 
+/* qcsmsgpool
+ *	defines state of a message pool */
+typedef struct msgpool_data_struct {
+	qcs_msg * free;		/* released messages, linked
+				 * through their store->next */
+} msgpool_data;
+
+/* qcslinkset
+ *	defines state of a link set */
+typedef struct linkset_data_struct {
+	int epfd;		/* epoll instance, watching rx sockets */
+	struct epoll_event * events;	/* QCS_LINKSET_EVENTS entries */
+} linkset_data;
+
 #endif	/* LINK_H */
@@ -30,117 +30,117 @@
 #include <string.h>
 
 #include "qcs_link.h"
+#include "qcs_schema.h"
 #include "supp.h"
 #include "link.h"
+#include "codec.h"
 #include "p_vypress.h"
-#include "p_qchat.h"
-
-#define ADDCHAR(ch) do{raw_msg[(raw_len)++]=(ch);}while(0)
-#define ADDSTR(s) do{\
-	if(s==NULL){free(raw_msg);errno=ENOMSG;return NULL;}	\
-	memcpy(raw_msg+raw_len,(s),slen=strlen(s)+1);	\
-	raw_len+=slen;				\
-	}while(0)
-#define ADDCHAN(s) do{ADDCHAR('#');ADDSTR(s);}while(0)
-
-char * qcs__make_vypress_msg(
-	const qcs_msg * msg,
-	int * pmsg_len )
+
+static const struct qcs__layout vypress_layouts[QCS_SCHEMA_MSGS] = {
+	QCS_SCHEMA_COMMON(QCS_CODEC_LAYOUT)
+	QCS_SCHEMA_VYPRESS(QCS_CODEC_LAYOUT)
+};
+static const unsigned char vypress_msgids
+		[QCS_CODEC_OPCODES][QCS_SCHEMA_SUBCODES + 1] = {
+	QCS_SCHEMA_COMMON(QCS_CODEC_MSGID)
+	QCS_SCHEMA_VYPRESS(QCS_CODEC_MSGID)
+};
+static const struct qcs__codec vypress_codec = {
+	vypress_layouts, vypress_msgids
+};
+
+int qcs__encode_vypress(
+	const qcs_msg_view * msg,
+	char * msg_buf, size_t cap,
+	size_t * pmsg_len,
+	unsigned int * sig_seed )
 {
-	int raw_len = 0, slen;
-	char * msg_buf,
-		* raw_msg = (char *)malloc(QCP_MAXUDPSIZE);
-	
-	if( raw_msg==NULL ) {
-		errno = ENOMEM;
-		return NULL;
-	}
+	size_t raw_len;
 
-	switch(msg->msg)
-	{	/* process differences qc16<->vypresschat10 */
-
-	case QCS_MSG_TOPIC_CHANGE:
-		ADDCHAR('B');
-		ADDCHAN(msg->chan);
-		ADDSTR(msg->text);
-		break;
-		
-	case QCS_MSG_TOPIC_REPLY:
-		ADDCHAR('C');
-		ADDSTR(msg->dst);
-		ADDCHAN(msg->chan);
-		ADDSTR(msg->text);
-		break;
-
-	case QCS_MSG_INFO_REPLY:
-		ADDCHAR('G');
-		ADDSTR(msg->dst);
-		ADDSTR(msg->src);
-		ADDSTR(msg->text);
-		ADDSTR("VcProto1.0");
-		ADDSTR("0.0.0.0");
-		ADDSTR(msg->chan);
-		ADDSTR(msg->supp);
-		break;
-	default:
-		/* fallback to qc16 makeup */
-		free(raw_msg);
-		raw_msg = (char*)qcs__make_qchat_msg(msg, &raw_len);
-		break;
-	}
+	assert(msg && msg_buf && pmsg_len && sig_seed);
 
-	/* allocate buffer for final version */
-	msg_buf = malloc(QCP_MAXUDPSIZE+10);
-	if( msg_buf==NULL ) {
-		free(raw_msg);
-		errno = ENOMEM;
-		return NULL;
+	/* the message goes right behind its signature */
+	if(cap < QCS_SIGNATURE_LENGTH + 1) {
+		errno = EMSGSIZE;
+		return 0;
+	}
+	if(!qcs__encode_msg(&vypress_codec, msg,
+		msg_buf + QCS_SIGNATURE_LENGTH + 1,
+		cap - (QCS_SIGNATURE_LENGTH + 1), &raw_len))
+	{
+		return 0;
 	}
 
-	/* append msg id and register for duplicates */
-	qcs__generate_signature( msg_buf );
+	/* prepend msg id */
+	qcs__generate_signature( msg_buf, sig_seed );
+
+	*pmsg_len = raw_len + QCS_SIGNATURE_LENGTH + 1;
+	return 1;
+}
+
+int qcs__prepare_vypress(
+	const qcs_msg_view * msg,
+	unsigned int mask,
+	struct qcs__slot * slots, int * p_count,
+	char * msg_buf, size_t cap,
+	size_t * pmsg_len )
+{
+	size_t raw_len;
+	int i;
 
-	/* build up final "version" */
-	memcpy(msg_buf+10, raw_msg, raw_len);
-	if( pmsg_len ) {
-		*pmsg_len = raw_len + 10;
+	assert(msg && slots && p_count && msg_buf && pmsg_len);
+
+	/* the signature goes in front, it is written over per send */
+	if(cap < QCS_SIGNATURE_LENGTH + 1) {
+		errno = EMSGSIZE;
+		return 0;
+	}
+	if(!qcs__prepare_msg(&vypress_codec, msg, mask, slots, p_count,
+		msg_buf + QCS_SIGNATURE_LENGTH + 1,
+		cap - (QCS_SIGNATURE_LENGTH + 1), &raw_len))
+	{
+		return 0;
+	}
+	msg_buf[0] = 'X';
+	memset(msg_buf + 1, 'a', QCS_SIGNATURE_LENGTH);
+	for(i = 0; i < *p_count; i++) {
+		slots[i].offset += QCS_SIGNATURE_LENGTH + 1;
 	}
 
-	free(raw_msg);
+	*pmsg_len = raw_len + QCS_SIGNATURE_LENGTH + 1;
+	return 1;
+}
+
+int qcs__peek_vypress(
+	const char * src, int src_len,
+	qcs_msg_peek * peek )
+{
+	assert( src && peek );
+
+	peek->signature = NULL;
+	if( src_len < (QCS_SIGNATURE_LENGTH + 2) ) {
+		errno = ENOMSG;
+		return 0;
+	}
+	peek->signature = src + 1;
 
-	return msg_buf;
+	return qcs__peek_msg(&vypress_codec,
+		src + QCS_SIGNATURE_LENGTH + 1,
+		src_len - (QCS_SIGNATURE_LENGTH + 1), peek);
 }
 
-#define GETMODE(c) do {\
-	GETCHAR((c));\
-	(c)=qcs__local_qcmode(c);\
-	if((c)==QCS_UMODE_INVALID){\
-		qcs__cleanupmsg(msg);\
-		errno=ENOMSG;return 0;}\
-	}while(0)
-#define GETCHAR(c) do {\
-	if(!src_len){qcs__cleanupmsg(msg);errno=ENOMSG;return 0;}\
-	(c)=*(src++);	\
-	src_len--;	\
-	}while(0)
-#define GETSTR(sp) do {\
-	if(((sp)=qcs__gatherstr(&src,&src_len))==NULL) {\
-		errno=ENOMSG;		\
-		qcs__cleanupmsg(msg);	\
-		return 0;}	\
-	}while(0)
-#define GETCHAN(s) do{\
-	GETCHAR(ch);if(ch!='#'){errno=ENOMSG;qcs__cleanupmsg(msg);return 0;}\
-	GETSTR(s);} while(0)
-
-int qcs__parse_vypress_msg(
+int qcs__parse_vypress_view(
 	const char * src, int src_len,
-	qcs_msg * msg )
+	qcs_msg_view * msg,
+	struct qcs__dup_cache * dup,
+	struct qcs__filter * filter )
 {
-	int parsed_ok;
-	char ch;
+	qcs_msg_peek peek;
+	int dropped = 0;
 
-	qcs__cleanupmsg(msg);
+	memset(msg, 0, sizeof(qcs_msg_view));
+	msg->msg = QCS_MSG_INVALID;
+	msg->mode = QCS_UMODE_INVALID;
 
 	/* check for signature consistency and duplicates */
 	if( src_len < (QCS_SIGNATURE_LENGTH + 2) ) {
@@ -148,12 +148,25 @@ int qcs__parse_vypress_msg(
 		errno = ENOMSG;
 		return 0;
 	}
-	if( qcs__known_dup_entry(src+1)) {
+	if( qcs__dup_check(dup, src+1)) {
 		/* duplicate encountered: ignore */
 		return 1;
-	} else {
-		/* not seen before: register */
-		qcs__insert_dup_entry(src+1);
+	}
+
+	if(filter!=NULL && filter->fn!=NULL) {
+		if(!qcs__peek_vypress(src, src_len, &peek)) {
+			return 0;
+		}
+		dropped = !filter->fn(&peek, filter->data);
+		if(dropped) {
+			QCS_COUNT(filter->dropped, 1);
+		}
+
+		/* CHANNEL_LEAVE is decoded anyway: leaving
+		 * "Main" flushes the cache (see below) */
+		if(dropped && peek.msg!=QCS_MSG_CHANNEL_LEAVE) {
+			return 1;
+		}
 	}
 
 	/* skip signature: already parsed */
@@ -161,45 +174,50 @@ int qcs__parse_vypress_msg(
 	src_len -= QCS_SIGNATURE_LENGTH + 1;
 
 	/* parse message contents */
-	switch( *(src++) )
-	{
-	case 'B':
-		msg->msg = QCS_MSG_TOPIC_CHANGE;
-		GETCHAN(msg->chan);
-		GETSTR(msg->text);
-		break;
-	case 'C':
-		msg->msg = QCS_MSG_TOPIC_REPLY;
-		GETSTR(msg->dst);
-		GETCHAN(msg->chan);
-		GETSTR(msg->text);
-		break;
-	case 'G':
-		msg->msg = QCS_MSG_INFO_REPLY;
-		GETSTR(msg->dst);
-		GETSTR(msg->src);
-		GETSTR(msg->text);
-		GETSTR(msg->chan);free(msg->chan);
-		GETSTR(msg->chan);free(msg->chan);
-		GETSTR(msg->chan);
-		GETSTR(msg->supp);
-		break;
-	default:
-		/* where it doesn't diff: parse with qc parser */
-		parsed_ok = qcs__parse_qchat_msg(src-1, src_len, msg);
-
-		/* flush msg id cache if the user has left the net
-		 * (seems like, vypress chat v1.0 repeats the same
-		 * msg id, if restarted: unseeded rand() ??)
-		 */
-		if(parsed_ok && msg->msg==QCS_MSG_CHANNEL_LEAVE
-			&& !strcasecmp(msg->chan, "main"))
-		{
-			qcs__cleanup_dup();
-		}
+	if(!qcs__decode_msg(&vypress_codec, src, src_len, msg)) {
+		return 0;
+	}
 
-		return parsed_ok;
+	/* flush msg id cache if the user has left the net
+	 * (seems like, vypress chat v1.0 repeats the same
+	 * msg id, if restarted: unseeded rand() ??)
+	 */
+	if(msg->msg==QCS_MSG_CHANNEL_LEAVE
+		&& msg->chan.len==4
+		&& !strncasecmp(msg->chan.str, "main", 4))
+	{
+		qcs__dup_flush(dup);
 	}
 
+	if(dropped) {
+		memset(msg, 0, sizeof(qcs_msg_view));
+		msg->msg = QCS_MSG_INVALID;
+		msg->mode = QCS_UMODE_INVALID;
+	}
 	return 1;
 }
+
+int qcs__msgfilter_vypress(
+	const enum qcs_msgid * accepted,
+	unsigned int offset,
+	struct sock_filter * prog, int max )
+{
+	enum qcs_msgid with_leave[QCS_SCHEMA_MSGS + 2];
+	int n;
+
+	/* CHANNEL_LEAVE has to get through: leaving "Main"
+	 * flushes the duplicate cache (see above) */
+	with_leave[0] = QCS_MSG_CHANNEL_LEAVE;
+	for(n = 1; *accepted!=QCS_MSG_INVALID; accepted++) {
+		if(n==QCS_SCHEMA_MSGS + 1) {
+			errno = EINVAL;
+			return 0;
+		}
+		with_leave[n++] = *accepted;
+	}
+	with_leave[n] = QCS_MSG_INVALID;
+
+	/* message goes behind the signature */
+	return qcs__compile_msgfilter(&vypress_codec, with_leave,
+		offset + QCS_SIGNATURE_LENGTH + 1, prog, max);
+}
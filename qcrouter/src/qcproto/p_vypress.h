@@ -27,7 +27,17 @@
 #ifndef P_VYPRESS_H
 #define P_VYPRESS_H
 
-char * qcs__make_vypress_msg(const qcs_msg *, int *);
-int qcs__parse_vypress_msg(const char *, int, qcs_msg *);
+struct sock_filter;
+struct qcs__slot;
+
+int qcs__encode_vypress(const qcs_msg_view *, char *, size_t, size_t *,
+		unsigned int *);
+int qcs__prepare_vypress(const qcs_msg_view *, unsigned int,
+		struct qcs__slot *, int *, char *, size_t, size_t *);
+int qcs__peek_vypress(const char *, int, qcs_msg_peek *);
+int qcs__parse_vypress_view(const char *, int, qcs_msg_view *,
+		struct qcs__dup_cache *, struct qcs__filter *);
+int qcs__msgfilter_vypress(const enum qcs_msgid *, unsigned int,
+		struct sock_filter *, int);
 
 #endif	/* P_VYPRESS_H */
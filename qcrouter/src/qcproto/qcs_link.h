@@ -25,10 +25,18 @@
 #ifndef QCS_LINK_H
 #define QCS_LINK_H
 
+#include <stddef.h>
+
 /* API constants
  */
 #define QCS_PROTO_QCHAT		0x0
 #define QCS_PROTO_VYPRESS	0x1
+#define QCS_PROTO_AUTO		0x2	/* both, told apart per datagram */
+
+/* link I/O backends (see qcs_link_opts) */
+#define QCS_BACKEND_SOCKETS	0x0
+#define QCS_BACKEND_URING	0x1
+#define QCS_BACKEND_SEGMENT	0x2
 
 #define QCS_UMODE_NORMAL	0x01
 #define QCS_UMODE_DND		0x02
@@ -38,6 +46,9 @@
 #define QCS_UMODE_WATCH		0x80
 #define QCS_UMODE_INVALID	0x00
 
+/* vypress chat message signature length (chars) */
+#define QCS_SIGNATURE_LENGTH	(9)
+
 enum qcs_msgid {
 	QCS_MSG_INVALID = 0,
 
@@ -220,6 +231,21 @@ enum qcs_textid {
 	QCS_CHAN
 };
 
+/* qcs_rxinfo:
+ *	where and when a message was received from
+ *	(all zero for messages, that were not received) */
+typedef struct _qcs_rxinfo {
+	unsigned long long stamp_ns;
+		/* kernel receive time: ns since the epoch */
+	unsigned long src_ip;	/* sender address (host byte order) */
+	unsigned short src_port;
+	unsigned long dst_ip;	/* address, the datagram was sent to:
+				 * broadcast or local (host byte order) */
+	int ifindex;		/* receiving interface */
+	int proto;		/* protocol of the datagram:
+				 * QCS_PROTO_QCHAT/QCS_PROTO_VYPRESS */
+} qcs_rxinfo;
+
 /* qcs_msg:
  *	protocol message type */
 typedef struct _qcs_msg {
@@ -230,32 +256,201 @@ typedef struct _qcs_msg {
 	char * text;
 	char * supp;	/* supplementary text */
 	char * chan;	/* channels (in '#Main#...#' form) */
+	qcs_rxinfo rx;	/* receive info */
+
+	struct qcs__msg_store * store;
+		/* (internal) field storage of messages made by
+		 * qcs_newmsg(), NULL for zeroed, caller-owned ones */
 } qcs_msg;
 
+/* qcs_strview:
+ *	borrowed string, pointing into a receive buffer;
+ *	str is NUL-terminated (or NULL, if the field is not present)
+ */
+typedef struct _qcs_strview {
+	const char * str;
+	int len;	/* length, not counting the '\0' */
+} qcs_strview;
+
+/* qcs_msg_view:
+ *	protocol message decoded without any allocation:
+ *	fields are valid until the next receive on the link */
+typedef struct _qcs_msg_view {
+	enum qcs_msgid msg;	/* message ID */
+	int mode;	/* user mode: offline/dnd, etc | watch */
+	qcs_strview src;	/* src nickname */
+	qcs_strview dst;	/* dst nickname */
+	qcs_strview text;
+	qcs_strview supp;	/* supplementary text */
+	qcs_strview chan;	/* channels (in '#Main#...#' form) */
+	qcs_rxinfo rx;		/* receive info */
+} qcs_msg_view;
+
+/* qcs_msg_peek:
+ *	what can be told about a datagram without decoding its body:
+ *	fields point into the datagram */
+typedef struct _qcs_msg_peek {
+	enum qcs_msgid msg;	/* message ID */
+	qcs_strview src;	/* src nickname (NULL if message has none) */
+	const char * signature;	/* vypress chat: QCS_SIGNATURE_LENGTH
+				 * chars, not terminated (NULL for qchat) */
+} qcs_msg_peek;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* qcs_link:
+ *	link handle; all the state of a link is kept in the link
+ *	itself, thus distinct links can be driven concurrently from
+ *	different threads without locking. A single link must not
+ *	be used from more than one thread at a time	*/
 typedef void* qcs_link;
 
+/* qcs_segment:
+ *	in-process network segment: links opened on it (with
+ *	QCS_BACKEND_SEGMENT) see each other's datagrams, as hosts on
+ *	a LAN do, without any network interface. Links get addresses
+ *	10.0.0.1, 10.0.0.2, ... in the order they are opened; datagram
+ *	to the address of a link goes to that link only, the rest to
+ *	every link on the destination port (the sender included)	*/
+typedef void* qcs_segment;
+
+/* qcs_link_opts:
+ *	optional link parameters for qcs_open_ex():
+ *	fill in the defaults with qcs_initopts() first	*/
+typedef struct _qcs_link_opts {
+	unsigned int dup_cache_size;
+		/* number of recent vypress message signatures
+		 * remembered for duplicate detection (0 - default) */
+	unsigned int rx_fanout;
+		/* number of rx sockets sharing the port with
+		 * SO_REUSEPORT, each one a sub-link with its own
+		 * receive queue (see qcs_sublink); 0/1 - just one */
+	int rx_fanout_cpu;
+		/* 0: datagrams are spread between sub-links by
+		 *    sender address & port,
+		 * non-0: by the CPU, that received the datagram:
+		 *    sub-link N takes CPU N (modulo rx_fanout) and
+		 *    is tied to it with SO_INCOMING_CPU. Copies of a
+		 *    vypress chat message (e.g. sent to two broadcast
+		 *    addresses) may land on different sub-links, whose
+		 *    duplicate caches are apart: duplicate detection
+		 *    is not guaranteed on QCS_PROTO_VYPRESS/AUTO links */
+	unsigned int tx_rate;
+		/* send pacing: max datagrams per second, every broadcast
+		 * address counting as one; 0 - send right away.
+		 * A paced link queues what it may not send yet and
+		 * sends it with qcs_flush() (see qcs_txtimer)	*/
+	unsigned int tx_burst;
+		/* datagrams, that a paced link may send back to back */
+	unsigned int tx_queue;
+		/* max messages queued by a paced/non-blocking link */
+	int tx_nonblock;
+		/* non-0: tx socket is non-blocking, what it does not
+		 * take is queued, to be sent with qcs_flush(), when
+		 * it gets writable (see qcs_txsocket/qcs_txqueue) */
+	int backend;
+		/* QCS_BACKEND_SOCKETS: plain socket calls,
+		 * QCS_BACKEND_URING: io_uring, receiving with multishot
+		 *    recvmsg into buffers provided to the kernel, sending
+		 *    a datagram to every broadcast address with one chain
+		 *    of linked sendmsg's; a link falls back to sockets,
+		 *    if the kernel can't do that (see qcs_backend),
+		 * QCS_BACKEND_SEGMENT: on the in-process segment; the link
+		 *    has an eventfd for rx socket, no tx socket (sends
+		 *    don't block), no fan-out nor message filters	*/
+	unsigned int mcast_ttl;
+		/* hops multicast datagrams may take (0 - kernel default,
+		 * the local network only). Multicast addresses on the
+		 * broadcast list are sent to & joined as groups	*/
+	int mcast_loop;
+		/* non-0 (default): multicast sent is looped back to
+		 * the members on this host, other links included	*/
+	unsigned long mcast_if;
+		/* address of the interface multicast goes out of and
+		 * groups are joined on (0 - routing decides)	*/
+	qcs_segment segment;
+		/* segment of a QCS_BACKEND_SEGMENT link	*/
+} qcs_link_opts;
+
+/* qcs_initopts
+ *	fills in default link options	*/
+void qcs_initopts(qcs_link_opts * opts);
+
 /* qcs_open
- *	initializes network link	*/
+ *	initializes network link.
+ *	A QCS_PROTO_AUTO link serves qchat and vypress chat users on the
+ *	same port: datagrams are decoded by the protocol they are in
+ *	(rx.proto of the message) and the protocol of every sender is
+ *	remembered by nickname. Messages to a known user are sent in the
+ *	protocol of the user, the rest go out in both protocols	*/
 qcs_link qcs_open( 
-	int	proto_mode,	/* QCS_PROTO_QCHAT/QCS_PROTO_VYPRESS	*/
+	int	proto_mode,	/* QCS_PROTO_QCHAT/VYPRESS/AUTO	*/
 	const unsigned long * broadcasts,
 		/* 0UL terminated list of bcst addresses */
 	unsigned short port );	/* port to bind to (if 0, uses def.)	*/
 
+/* qcs_open_ex
+ *	initializes network link with options specified
+ *	(opts can be NULL to use defaults)	*/
+qcs_link qcs_open_ex(
+	int	proto_mode,
+	const unsigned long * broadcasts,
+	unsigned short port,
+	const qcs_link_opts * opts );
+
 /* qcs_close
- *	close specified link 		*/
+ *	close specified link (with its sub-links)	*/
 int qcs_close(qcs_link link);
 
+/* qcs_sublink
+ *	returns sub-link `index' of a link opened with rx_fanout
+ *	(0 is the link itself) or NULL.
+ *	Every sub-link receives its share of datagrams, with its own
+ *	buffers, duplicate cache and filters, so each one may be served
+ *	by a thread of its own. Sub-links can't send and are closed
+ *	with their link
+ */
+qcs_link qcs_sublink(
+	qcs_link link,
+	unsigned int index );
+
 /* qcs_rxsocket
  *	return RX socket identifier	*/
 int qcs_rxsocket(
 	qcs_link link,
 	int * p_rxsocket );	/* pointer to id store */
 
+/* qcs_rxpollfd
+ *	returns fd to poll for RX input: the rx socket, or the
+ *	io_uring of a QCS_BACKEND_URING link (its rx socket is
+ *	drained into the ring buffers as datagrams arrive)	*/
+int qcs_rxpollfd(
+	qcs_link link,
+	int * p_fd );
+
+/* qcs_backend
+ *	tells backend of the link: QCS_BACKEND_SOCKETS/URING/SEGMENT */
+int qcs_backend(
+	qcs_link link,
+	int * p_backend );
+
+/* qcs_mcast_join, qcs_mcast_leave
+ *	join/leave multicast group on the interface with address
+ *	`ifaddr' (0 - mcast_if of the link). Datagrams sent to the
+ *	groups joined are received by the link and its sub-links.
+ *	Groups on the broadcast list are joined by qcs_open().
+ *	(no-op on a segment: every link gets the groups of its port) */
+int qcs_mcast_join(
+	qcs_link link,
+	unsigned long group,
+	unsigned long ifaddr );
+int qcs_mcast_leave(
+	qcs_link link,
+	unsigned long group,
+	unsigned long ifaddr );
+
 /* qcs_waitinput
  *	for RX input, or return in non-blocking mode (if timeout==0)
  * returns:
@@ -267,26 +462,334 @@ int qcs_waitinput(
 	qcs_link link,
 	int timeout_ms );	/* msecs to wait before timeout */
 
+/* qcs_newsegment, qcs_deletesegment
+ *	create/delete in-process segment (the links on it are to be
+ *	closed first); a segment can be used from many threads	*/
+qcs_segment qcs_newsegment();
+void qcs_deletesegment(qcs_segment);
+
+/* qcs_linkset:
+ *	set of links to wait for input on (epoll based): a link in
+ *	the set has its rx socket switched to non-blocking mode, so
+ *	qcs_recv*() fail with EAGAIN once the link is drained	*/
+typedef void* qcs_linkset;
+
+/* qcs_newlinkset, qcs_deletelinkset
+ *	create/delete empty link set (links in the set are not closed) */
+qcs_linkset qcs_newlinkset();
+void qcs_deletelinkset(qcs_linkset);
+
+/* qcs_linkset_add, qcs_linkset_remove
+ *	adds link to/removes link from the set:
+ *	a closed link is removed from all sets automatically	*/
+int qcs_linkset_add(qcs_linkset set, qcs_link link);
+int qcs_linkset_remove(qcs_linkset set, qcs_link link);
+
+/* qcs_linkset_wait
+ *	waits for RX input on any link in the set (edge-triggered:
+ *	a link is returned once, when new input arrives, and has
+ *	to be received from until EAGAIN before it is reported again);
+ *	send queues of paced/non-blocking links in the set are served
+ *	meanwhile
+ * returns:
+ *	0 if timed-out (timeout_ms < 0 - wait forever)
+ *	>0 number of links stored in ready[]
+ *	<0, if error (see errno)
+ */
+int qcs_linkset_wait(
+	qcs_linkset set,
+	qcs_link * ready,	/* max_ready entries */
+	int max_ready,
+	int timeout_ms );
+
+/* qcs_linkset_fd
+ *	returns epoll fd of the set, to nest it into another event loop:
+ *	it polls readable, when qcs_linkset_wait() with timeout_ms 0
+ *	has links to report or send queues to serve	*/
+int qcs_linkset_fd(
+	qcs_linkset set,
+	int * p_fd );
+
 /* qcs_send
  *	sends message to the link	*/
 int qcs_send(
 	qcs_link link,
 	const qcs_msg * msg );
 
+/* qcs_send_batch
+ *	sends `count' messages to the link: every message is sent
+ *	to every broadcast address, all with as few system calls
+ *	as possible. messages that cannot be built are skipped.
+ *	A paced or non-blocking link queues the messages and sends as
+ *	many, as its rate allows and its tx socket takes, never
+ *	blocking; those that don't fit into the queue are dropped
+ * returns:
+ *	number of messages sent to at least one broadcast address
+ *	(or queued), 0 if none was (see errno: ENOBUFS - queue full)
+ */
+int qcs_send_batch(
+	qcs_link link,
+	const qcs_msg * const * msgs,
+	int count );
+
+/* qcs_send_view
+ * qcs_send_view_batch
+ *	qcs_send/qcs_send_batch of messages given as views: fields are
+ *	encoded straight from the caller's strings, with no copy made
+ *	into a qcs_msg (a field str needs no '\0', len bytes are sent;
+ *	str==NULL - field not present). rx of the views is ignored
+ */
+int qcs_send_view(
+	qcs_link link,
+	const qcs_msg_view * view );
+
+int qcs_send_view_batch(
+	qcs_link link,
+	const qcs_msg_view * views,
+	int count );
+
+/* qcs_prepared:
+ *	message encoded once for a link, with the fields that change
+ *	from send to send left as slots: sending it copies the datagram
+ *	with the slots filled in (and a new vypress chat signature),
+ *	the encoder is not run again */
+typedef void* qcs_prepared;
+
+/* QCS_SLOT
+ *	slots of a prepared message: text fields (by qcs_textid)
+ *	and the user mode (mode and watch flag, where sent) */
+#define QCS_SLOT(textid)	(1U << (textid))
+#define QCS_SLOT_MODE		(1U << 5)
+#define QCS_SLOT_ALL	(QCS_SLOT(QCS_SRC) | QCS_SLOT(QCS_DST) \
+	| QCS_SLOT(QCS_TEXT) | QCS_SLOT(QCS_SUPP) | QCS_SLOT(QCS_CHAN) \
+	| QCS_SLOT_MODE)
+
+/* qcs_newprepared
+ *	prepares msg to be sent on the link, with the fields in slots
+ *	(QCS_SLOT_*) filled in per send: those may be NULL in msg
+ * returns:
+ *	NULL on failure (EINVAL - msg cannot be built)
+ */
+qcs_prepared qcs_newprepared(
+	qcs_link link,
+	const qcs_msg * msg,
+	unsigned int slots );
+
+void qcs_deleteprepared(qcs_prepared);
+
+/* qcs_send_prepared
+ *	qcs_send_view_batch of `count' messages, the prepared message
+ *	with its slots filled in from the fields of each of fills
+ *	(the rest of fills, msg included, is ignored). prep must
+ *	have been prepared for the link
+ */
+int qcs_send_prepared(
+	qcs_link link,
+	qcs_prepared prep,
+	const qcs_msg_view * fills,
+	int count );
+
+/* qcs_txtimer
+ *	returns timer of a paced link: it gets readable, when the link
+ *	may send more of its queue, and qcs_flush() is to be called.
+ *	(qcs_linkset_wait() does that for the links in the set)
+ *	-1 is stored for a link, that is not paced	*/
+int qcs_txtimer(
+	qcs_link link,
+	int * p_timerfd );
+
+/* qcs_txsocket
+ *	return TX socket identifier (-1 on QCS_BACKEND_SEGMENT links) */
+int qcs_txsocket(
+	qcs_link link,
+	int * p_txsocket );
+
+/* qcs_txqueue
+ *	tells how many messages wait in the send queue of the link,
+ *	and whether it is blocked on the tx socket: then qcs_flush()
+ *	is to be called, when qcs_txsocket() polls POLLOUT
+ *	(drops of a full queue are counted in qcs_stats)	*/
+int qcs_txqueue(
+	qcs_link link,
+	unsigned int * p_queued,	/* may be NULL */
+	int * p_blocked );		/* may be NULL */
+
+/* qcs_flush
+ *	sends queued datagrams of a paced or non-blocking link, as
+ *	many as its rate allows now and its tx socket takes, and
+ *	arms the link timer for the rest	*/
+int qcs_flush(qcs_link link);
+
+/* qcs_encode
+ *	builds the datagram, that qcs_send() would send for msg,
+ *	into caller-supplied buffer of `cap' bytes (with vypress
+ *	signature in front of it, on vypress links); no allocation
+ *	takes place. On QCS_PROTO_AUTO links, that is the datagram
+ *	in the protocol of the user msg is for, qchat if unknown
+ * returns:
+ *	non-0 on success, datagram length in *p_len
+ *	0 on failure: errno is set to
+ *		EMSGSIZE, if the datagram does not fit into buf,
+ *		ENOMSG, if msg is invalid or misses required fields
+ */
+int qcs_encode(
+	qcs_link link,
+	const qcs_msg * msg,
+	char * buf,
+	size_t cap,
+	size_t * p_len );
+
 /* qcs_recv
  *	retrieves message from the link		*/
 int qcs_recv(
 	qcs_link link,
 	qcs_msg * msg );
 
+/* qcs_recv_batch
+ *	retrieves up to `max' messages from the link with a single
+ *	syscall: blocks until at least one datagram is available,
+ *	then drains whatever is queued without waiting.
+ *	malformed datagrams and duplicates are skipped, thus
+ *	*p_count may be less than the number of datagrams read
+ *	(or even 0)
+ * returns:
+ *	non-0 on success,
+ *	0 on failure (see errno)
+ */
+int qcs_recv_batch(
+	qcs_link link,
+	qcs_msg ** msgs,	/* array of `max' allocated messages */
+	int max,
+	int * p_count );	/* number of messages filled in */
+
+/* qcs_recv_view
+ *	retrieves message from the link, without copying its fields:
+ *	view points into the link's receive buffer and is valid until
+ *	the next qcs_recv* call on the link.
+ *	use qcs_msgfromview() to get an owning copy
+ */
+int qcs_recv_view(
+	qcs_link link,
+	qcs_msg_view * view );
+
+/* qcs_peek
+ *	classifies datagram of the `proto_mode' protocol: finds message
+ *	id and sender, skipping only the fields in front of the sender.
+ *	Doesn't allocate, validate the rest of the message or check for
+ *	vypress chat duplicates.
+ * returns:
+ *	non-0 on success,
+ *	0 on failure (ENOMSG: unknown message or no terminated sender)
+ */
+int qcs_peek(
+	int proto_mode,		/* QCS_PROTO_QCHAT/VYPRESS/AUTO	*/
+	const char * buf,
+	int len,
+	qcs_msg_peek * peek );
+
+/* qcs_recv_filter:
+ *	called with qcs_peek() result for every datagram received on the
+ *	link (except vypress chat duplicates), before it is decoded.
+ * returns:
+ *	non-0 to decode the datagram, 0 to drop it
+ */
+typedef int (* qcs_recv_filter)(const qcs_msg_peek * peek, void * data);
+
+/* qcs_setrecvfilter
+ *	sets (or removes, with filter==NULL) receive filter of the link:
+ *	dropped datagrams are treated as vypress chat duplicates are,
+ *	i.e. qcs_recv/qcs_recv_view return QCS_MSG_INVALID for them
+ *	and qcs_recv_batch skips them
+ */
+int qcs_setrecvfilter(
+	qcs_link link,
+	qcs_recv_filter filter,
+	void * data );	/* passed to filter */
+
+/* qcs_setmsgfilter
+ *	makes the kernel drop datagrams of message types not listed,
+ *	before they are copied to userspace (classic BPF program on
+ *	the rx socket, replacing the previous one).
+ *	Vypress chat CHANNEL_LEAVE always gets through (duplicate
+ *	detection depends on it), so do datagrams queued already.
+ *	Fails with EOPNOTSUPP on QCS_BACKEND_SEGMENT links
+ */
+int qcs_setmsgfilter(
+	qcs_link link,
+	const enum qcs_msgid * accepted );
+		/* QCS_MSG_INVALID terminated list of message ids
+		 * to receive, or NULL to remove the filter */
+
+/* number of message ids (QCS_MSG_INVALID included) */
+#define QCS_MSG_COUNT	(QCS_MSG_PRIVATE_ME + 1)
+
+/* qcs_stats:
+ *	traffic & drop counters of a link, since it was opened */
+typedef struct _qcs_stats {
+	unsigned long long rx_msgs[QCS_MSG_COUNT];
+		/* messages decoded, by message id */
+	unsigned long long tx_msgs[QCS_MSG_COUNT];
+		/* messages sent to at least one broadcast address */
+
+	unsigned long long rx_datagrams, rx_bytes;
+	unsigned long long rx_malformed;	/* failed to parse */
+	unsigned long long rx_duplicates;	/* vypress dup cache hits */
+	unsigned long long rx_filtered;	/* dropped by receive filter */
+	unsigned long long rx_kernel_drops;
+		/* dropped by the kernel (SO_RXQ_OVFL): rx socket buffer
+		 * full or, with qcs_setmsgfilter() or rx_fanout, rejected
+		 * by the socket filter (the kernel counts both alike) */
+
+	unsigned long long tx_datagrams, tx_bytes;
+		/* one for every broadcast address a message went to */
+	unsigned long long tx_errors;	/* datagrams that failed to go */
+	unsigned long long tx_invalid;	/* messages failed to encode */
+	unsigned long long tx_queue_drops;
+		/* messages dropped: send queue of a paced link full */
+} qcs_stats;
+
+/* qcs_link_stats
+ *	fills in counters of the link and its sub-links (of the
+ *	sub-link alone, if called on one). Counting takes no locks,
+ *	so this may be called from any thread, while the link is
+ *	in use: counters are read one by one, not as a snapshot
+ */
+int qcs_link_stats(
+	qcs_link link,
+	qcs_stats * stats );
+
 /* qcs_newmsg
  * qcs_deletemsg
- *	(de)allocates & initializes new message struct	*/
+ *	(de)allocates & initializes new message struct:
+ *	the message keeps its field buffers while it lives,
+ *	short fields are stored inline, without malloc() */
 qcs_msg * qcs_newmsg();
 
 void qcs_deletemsg(
 	qcs_msg * msg  );	/* msg to delete	*/
 
+/* qcs_msgpool:
+ *	recycles messages: a released message keeps its field buffers,
+ *	so acquiring and filling it in does not allocate, once the
+ *	pool has warmed up. A pool is used from one thread at a time */
+typedef void* qcs_msgpool;
+
+/* qcs_newmsgpool
+ * qcs_deletemsgpool
+ *	create a pool with `prealloc' messages ready/delete the pool
+ *	with all the released messages (messages acquired and not
+ *	released yet stay valid and are deleted with qcs_deletemsg) */
+qcs_msgpool qcs_newmsgpool(unsigned int prealloc);
+void qcs_deletemsgpool(qcs_msgpool pool);
+
+/* qcs_acquiremsg
+ * qcs_releasemsg
+ *	takes a cleared message from the pool (NULL, if out of memory)/
+ *	returns message to the pool (it must come from qcs_newmsg() or
+ *	qcs_acquiremsg(), of any pool) */
+qcs_msg * qcs_acquiremsg(qcs_msgpool pool);
+void qcs_releasemsg(qcs_msgpool pool, qcs_msg * msg);
+
 /* qcs_msgset
  *	sets message text parameter
  */
@@ -295,6 +798,14 @@ int qcs_msgset(
 	enum qcs_textid which,
 	const char * new_text );
 
+/* qcs_msgfromview
+ *	materializes the view: replaces msg contents with
+ *	copies of the fields in view
+ */
+int qcs_msgfromview(
+	qcs_msg * msg,
+	const qcs_msg_view * view );
+
 #ifdef __cplusplus
 }
 #endif
@@ -305,13 +816,74 @@ int qcs_msgset(
  * 	C++ interface
  */
 
+#include <string.h>
+#include <strings.h>
+#include "qcs_schema.h"
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
 class QcsLink;
 
+#if __cplusplus >= 201402L
+/* QcsLayout, QcsSchema<Proto>:
+ *	message schema, resolved at compile time	*/
+struct QcsLayout {
+	char opcode;		/* 0 - not in the protocol */
+	char subcode;
+	const char * fields;	/* QCS_F_* codes */
+	const char * consts;	/* strings for QCS_F_CONST fields */
+};
+
+#define QCS_CXX_LAYOUT(id, op, sub, fields, consts) \
+	case QCS_MSG_##id: return QcsLayout{ (op), (sub), (fields), (consts) };
+
+template<int Proto> struct QcsSchema;
+
+template<> struct QcsSchema<QCS_PROTO_QCHAT> {
+	static constexpr QcsLayout layout(qcs_msgid id) {
+		switch(id) {
+		QCS_SCHEMA_COMMON(QCS_CXX_LAYOUT)
+		QCS_SCHEMA_QCHAT(QCS_CXX_LAYOUT)
+		default: return QcsLayout{ 0, 0, "", "" };
+		}
+	}
+};
+
+template<> struct QcsSchema<QCS_PROTO_VYPRESS> {
+	static constexpr QcsLayout layout(qcs_msgid id) {
+		switch(id) {
+		QCS_SCHEMA_COMMON(QCS_CXX_LAYOUT)
+		QCS_SCHEMA_VYPRESS(QCS_CXX_LAYOUT)
+		default: return QcsLayout{ 0, 0, "", "" };
+		}
+	}
+};
+
+#undef QCS_CXX_LAYOUT
+#endif	/* __cplusplus >= 201402L */
+
 class QcsMsg {
 	qcs_msg * m_msg;
 public:
 	QcsMsg() { m_msg = qcs_newmsg(); }
 	~QcsMsg() { qcs_deletemsg(m_msg); }
+#if __cplusplus >= 201103L
+	/* move-only: the qcs_msg is owned */
+	QcsMsg(const QcsMsg &) = delete;
+	QcsMsg & operator=(const QcsMsg &) = delete;
+	QcsMsg(QcsMsg && other) noexcept : m_msg(other.m_msg) {
+		other.m_msg = NULL;
+	}
+	QcsMsg & operator=(QcsMsg && other) noexcept {
+		if(this!=&other) {
+			qcs_deletemsg(m_msg);
+			m_msg = other.m_msg;
+			other.m_msg = NULL;
+		}
+		return *this;
+	}
+#endif
 
 	qcs_msgid msg() { return m_msg->msg; }
 	int umode() { return m_msg->mode; }
@@ -412,9 +984,344 @@ public:
 
 	/* XXX: implement more asXXX */
 
+#if __cplusplus >= 201402L
+	/* encodeBody<Proto, Id>:
+	 *	encodes message body (without vypress chat signature)
+	 *	with the layout of Id known at compile time;
+	 *	fails if the message is not Id, a field is missing
+	 *	or the message doesn't fit in cap bytes	*/
+	template<int Proto, qcs_msgid Id>
+	bool encodeBody(char * buf, size_t cap, size_t * p_len) const {
+		constexpr QcsLayout layout = QcsSchema<Proto>::layout(Id);
+		static_assert(layout.opcode!=0,
+			"message is not in the protocol schema");
+		const char * konst = layout.consts;
+		size_t len = 0;
+
+		if(m_msg->msg!=Id) return false;
+
+		if(!putChar(buf, cap, len, layout.opcode)) return false;
+		if(layout.subcode
+			&& !putChar(buf, cap, len, layout.subcode)) return false;
+
+		for(const char * f = layout.fields; *f; f++) {
+			bool ok = true;
+			switch(*f) {
+			case 's': ok = putStr(buf, cap, len, m_msg->src); break;
+			case 'd': ok = putStr(buf, cap, len, m_msg->dst); break;
+			case 't': ok = putStr(buf, cap, len, m_msg->text); break;
+			case 'p': ok = putStr(buf, cap, len, m_msg->supp); break;
+			case 'c': ok = putStr(buf, cap, len, m_msg->chan); break;
+			case '#':
+				ok = putChar(buf, cap, len, '#')
+					&& putStr(buf, cap, len, m_msg->chan);
+				break;
+			case 'm':
+				ok = putChar(buf, cap, len, netMode(m_msg->mode));
+				break;
+			case 'w':
+			case 'W':
+				ok = putChar(buf, cap, len,
+					(m_msg->mode & QCS_UMODE_WATCH) ? '1': '2');
+				break;
+			case '0':
+			case '_':
+				ok = putChar(buf, cap, len, '0');
+				break;
+			case 'k':
+				ok = putStr(buf, cap, len, konst);
+				konst += strlen(konst) + 1;
+				break;
+			case 'M':
+				ok = m_msg->chan!=NULL
+					&& !strcasecmp(m_msg->chan, "Main");
+				break;
+			}
+			if(!ok) return false;
+		}
+
+		*p_len = len;
+		return true;
+	}
+
+private:
+	static bool putChar(char * buf, size_t cap, size_t & len, char ch) {
+		if(len==cap) return false;
+		buf[len++] = ch;
+		return true;
+	}
+	static bool putStr(
+		char * buf, size_t cap, size_t & len, const char * s)
+	{
+		if(s==NULL) return false;
+		size_t slen = strlen(s) + 1;
+		if(slen > cap - len) return false;
+		memcpy(buf + len, s, slen);
+		len += slen;
+		return true;
+	}
+	static constexpr char netMode(int mode) {
+		return mode==QCS_UMODE_DND ? '1'
+			: mode==QCS_UMODE_AWAY ? '2'
+			: mode==QCS_UMODE_OFFLINE ? '3': '0';
+	}
+public:
+#endif	/* __cplusplus >= 201402L */
+
 	friend QcsLink;
 };
 
+#if __cplusplus >= 201703L
+/* QcsMessage:
+ *	move-only message, that keeps its fields itself: short ones
+ *	(nicknames, channels) in inline buffers, longer ones in a heap
+ *	buffer, that is kept for the next longer field. Getters return
+ *	views of the fields, QcsLink sends it as a qcs_msg_view, with
+ *	no qcs_msg made in between */
+class QcsMessage {
+public:
+	static constexpr size_t Inline = 32;	/* bytes, with the '\0' */
+
+	QcsMessage() = default;
+	QcsMessage(const QcsMessage &) = delete;
+	QcsMessage & operator=(const QcsMessage &) = delete;
+	QcsMessage(QcsMessage &&) noexcept = default;
+	QcsMessage & operator=(QcsMessage &&) noexcept = default;
+
+	qcs_msgid msg() const { return m_msg; }
+	int umode() const { return m_mode; }
+	const qcs_rxinfo & rx() const { return m_rx; }
+	std::string_view src() const { return m_fields[QCS_SRC].get(); }
+	std::string_view dst() const { return m_fields[QCS_DST].get(); }
+	std::string_view text() const { return m_fields[QCS_TEXT].get(); }
+	std::string_view supp() const { return m_fields[QCS_SUPP].get(); }
+	std::string_view chan() const { return m_fields[QCS_CHAN].get(); }
+	bool has(qcs_textid which) const { return m_fields[which].isSet(); }
+
+	void set(qcs_textid which, std::string_view str) {
+		m_fields[which].set(str);
+	}
+	void unset(qcs_textid which) { m_fields[which].unset(); }
+
+	/* clear:
+	 *	unsets everything, keeping the heap buffers */
+	void clear() {
+		m_msg = QCS_MSG_INVALID;
+		m_mode = QCS_UMODE_INVALID;
+		m_rx = qcs_rxinfo();
+		for(Field & f: m_fields) f.unset();
+	}
+
+	/* assign:
+	 *	copies the fields of view (of a received message) in */
+	void assign(const qcs_msg_view & view) {
+		const qcs_strview * views[Fields] = {
+			&view.src, &view.dst, &view.text, &view.supp, &view.chan
+		};
+		for(int i = 0; i < Fields; i++) {
+			if(views[i]->str==NULL) {
+				m_fields[i].unset();
+			} else {
+				m_fields[i].set(std::string_view(
+					views[i]->str, views[i]->len));
+			}
+		}
+		m_msg = view.msg;
+		m_mode = view.mode;
+		m_rx = view.rx;
+	}
+
+	/* view:
+	 *	the message as qcs_msg_view, valid while it is not changed
+	 *	(or moved from) */
+	qcs_msg_view view() const {
+		qcs_msg_view v = qcs_msg_view();
+		qcs_strview * views[Fields] = {
+			&v.src, &v.dst, &v.text, &v.supp, &v.chan
+		};
+		for(int i = 0; i < Fields; i++) {
+			if(m_fields[i].isSet()) {
+				views[i]->str = m_fields[i].get().data();
+				views[i]->len = (int)m_fields[i].get().size();
+			}
+		}
+		v.msg = m_msg;
+		v.mode = m_mode;
+		v.rx = m_rx;
+		return v;
+	}
+
+	void asRefreshRequest(std::string_view src, std::string_view dst) {
+		build(QCS_MSG_REFRESH_REQUEST);
+		set(QCS_SRC, src);
+		set(QCS_DST, dst);
+	}
+	void asRefreshAck(
+		std::string_view src, std::string_view dst, int umode)
+	{
+		build(QCS_MSG_REFRESH_ACK, umode);
+		set(QCS_SRC, src);
+		set(QCS_DST, dst);
+	}
+	void asChannelText(
+		std::string_view src, std::string_view chan,
+		std::string_view text, bool me)
+	{
+		build(me ? QCS_MSG_CHANNEL_ME: QCS_MSG_CHANNEL_BROADCAST);
+		set(QCS_SRC, src);
+		set(QCS_CHAN, chan);
+		set(QCS_TEXT, text);
+	}
+	void asChannelJoin(
+		std::string_view src, std::string_view chan, int umode)
+	{
+		build(QCS_MSG_CHANNEL_JOIN, umode);
+		set(QCS_SRC, src);
+		set(QCS_CHAN, chan);
+	}
+	void asChannelLeave(std::string_view src, std::string_view chan) {
+		build(QCS_MSG_CHANNEL_LEAVE);
+		set(QCS_SRC, src);
+		set(QCS_CHAN, chan);
+	}
+	void asMessageSend(
+		std::string_view src, std::string_view dst,
+		std::string_view text, bool mass=false)
+	{
+		build(mass ? QCS_MSG_MESSAGE_MASS: QCS_MSG_MESSAGE_SEND);
+		set(QCS_SRC, src);
+		set(QCS_DST, dst);
+		set(QCS_TEXT, text);
+	}
+	void asMessageAck(
+		std::string_view src, std::string_view dst,
+		std::string_view text, int umode )
+	{
+		build(QCS_MSG_MESSAGE_ACK, umode);
+		set(QCS_SRC, src);
+		set(QCS_DST, dst);
+		set(QCS_TEXT, text);
+	}
+	void asRename(std::string_view src, std::string_view to) {
+		build(QCS_MSG_RENAME);
+		set(QCS_SRC, src);
+		set(QCS_TEXT, to);
+	}
+	void asUmodeChange(std::string_view src, int umode) {
+		build(QCS_MSG_MODE_CHANGE, umode);
+		set(QCS_SRC, src);
+	}
+	void asWatchChange(std::string_view src, int watch) {
+		build(QCS_MSG_WATCH_CHANGE, watch);
+		set(QCS_SRC, src);
+	}
+	void asTopicChange(std::string_view text) {
+		build(QCS_MSG_TOPIC_CHANGE);
+		set(QCS_TEXT, text);
+	}
+	void asTopicReply(std::string_view dst, std::string_view text) {
+		build(QCS_MSG_TOPIC_REPLY);
+		set(QCS_DST, dst);
+		set(QCS_TEXT, text);
+	}
+	void asInfoRequest(std::string_view src, std::string_view dst) {
+		build(QCS_MSG_INFO_REQUEST);
+		set(QCS_SRC, src);
+		set(QCS_DST, dst);
+	}
+	void asInfoReply(
+		std::string_view src, std::string_view dst,
+		std::string_view text, std::string_view chan,
+		std::string_view supp )
+	{
+		build(QCS_MSG_INFO_REPLY);
+		set(QCS_SRC, src);
+		set(QCS_DST, dst);
+		set(QCS_TEXT, text);
+		set(QCS_CHAN, chan);
+		set(QCS_SUPP, supp);
+	}
+
+private:
+	static constexpr int Fields = QCS_CHAN + 1;
+
+	/* Field:
+	 *	'\0' terminated string, inline if it fits in Inline bytes */
+	class Field {
+		char m_inline[Inline];
+		char * m_heap = nullptr;
+		size_t m_cap = 0;	/* of m_heap */
+		size_t m_len = 0;
+		bool m_set = false;
+	public:
+		Field() = default;
+		~Field() { delete[] m_heap; }
+		Field(const Field &) = delete;
+		Field & operator=(const Field &) = delete;
+		Field(Field && other) noexcept { take(other); }
+		Field & operator=(Field && other) noexcept {
+			if(this!=&other) {
+				delete[] m_heap;
+				take(other);
+			}
+			return *this;
+		}
+
+		bool isSet() const { return m_set; }
+		std::string_view get() const {
+			if(!m_set) return std::string_view();
+			return std::string_view(
+				m_len < Inline ? m_inline: m_heap, m_len);
+		}
+		void unset() { m_set = false; m_len = 0; }
+		void set(std::string_view str) {
+			size_t len = str.size();
+			if(len < Inline) {
+				/* str may be the field itself */
+				memmove(m_inline, str.data(), len);
+				m_inline[len] = '\0';
+			} else if(len < m_cap) {
+				memmove(m_heap, str.data(), len);
+				m_heap[len] = '\0';
+			} else {
+				char * heap = new char[len + 1];
+				memcpy(heap, str.data(), len);
+				heap[len] = '\0';
+				delete[] m_heap;
+				m_heap = heap;
+				m_cap = len + 1;
+			}
+			m_len = len;
+			m_set = true;
+		}
+	private:
+		void take(Field & other) {
+			m_heap = other.m_heap;
+			m_cap = other.m_cap;
+			m_len = other.m_len;
+			m_set = other.m_set;
+			if(m_set && m_len < Inline) {
+				memcpy(m_inline, other.m_inline, m_len + 1);
+			}
+			other.m_heap = nullptr;
+			other.m_cap = 0;
+			other.unset();
+		}
+	};
+
+	void build(qcs_msgid id, int umode = QCS_UMODE_INVALID) {
+		clear();
+		m_msg = id;
+		m_mode = umode;
+	}
+
+	qcs_msgid m_msg = QCS_MSG_INVALID;
+	int m_mode = QCS_UMODE_INVALID;
+	qcs_rxinfo m_rx = qcs_rxinfo();
+	Field m_fields[Fields];
+};
+#endif	/* __cplusplus >= 201703L */
+
 class QcsLink {
 	qcs_link mLink;
 	int mProto;
@@ -435,6 +1342,7 @@ public:
 		return succ;
 	}
 	bool isOpen() { return mLink!=NULL; }
+	qcs_link handle() const { return mLink; }
 	int rxSocket() {
 		int sock;
 		qcs_rxsocket(mLink, &sock);
@@ -449,6 +1357,39 @@ public:
 	bool recv(QcsMsg &msg) {
 		return qcs_recv(mLink, msg.m_msg)!=0;
 	}
+	/* prepare:
+	 *	qcs_newprepared() of msg, for sendPrepared()
+	 *	(to be released with qcs_deleteprepared) */
+	qcs_prepared prepare(const QcsMsg &msg, unsigned int slots) {
+		return qcs_newprepared(mLink, msg.m_msg, slots);
+	}
+	int sendPrepared(qcs_prepared prep,
+		const qcs_msg_view * fills, int count)
+	{
+		return qcs_send_prepared(mLink, prep, fills, count);
+	}
+#if __cplusplus >= 201703L
+	bool send(const QcsMessage &msg) {
+		qcs_msg_view view = msg.view();
+		return qcs_send_view(mLink, &view)!=0;
+	}
+	/* send:
+	 *	sends view of the caller's strings, as they are	*/
+	bool send(const qcs_msg_view &view) {
+		return qcs_send_view(mLink, &view)!=0;
+	}
+	/* sendBatch:
+	 *	returns number of messages sent (see qcs_send_batch) */
+	int sendBatch(const qcs_msg_view * views, int count) {
+		return qcs_send_view_batch(mLink, views, count);
+	}
+	bool recv(QcsMessage &msg) {
+		qcs_msg_view view;
+		if(!qcs_recv_view(mLink, &view)) return false;
+		msg.assign(view);
+		return true;
+	}
+#endif
 };
 
 #endif	/* #ifdef __cplusplus */
@@ -0,0 +1,102 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	message schema: wire layout of every message
+ */
+
+#ifndef QCS_SCHEMA_H
+#define QCS_SCHEMA_H
+
+/* field codes:
+ *	each field of a layout is a single char, layouts are built
+ *	by concatenating these string literals
+ */
+#define QCS_F_SRC	"s"	/* src, '\0' terminated */
+#define QCS_F_DST	"d"	/* dst */
+#define QCS_F_TEXT	"t"	/* text */
+#define QCS_F_SUPP	"p"	/* supp */
+#define QCS_F_CHANS	"c"	/* chan, as is ('#Main#...#' list) */
+#define QCS_F_CHAN	"#"	/* '#', followed by chan name */
+#define QCS_F_MODE	"m"	/* user mode char */
+#define QCS_F_WATCH	"w"	/* watch flag char */
+#define QCS_F_OWATCH	"W"	/* watch flag char, optional on receive */
+#define QCS_F_ZERO	"0"	/* '0' (unknown purpose), skipped on receive */
+#define QCS_F_PAD	"_"	/* trailing '0', ignored on receive */
+#define QCS_F_CONST	"k"	/* next string of layout consts,
+				 * skipped on receive */
+#define QCS_F_MAIN	"M"	/* chan must be "Main" (not sent),
+				 * set to "Main" on receive */
+
+/* number of message ids in the schema */
+#define QCS_SCHEMA_MSGS		(QCS_MSG_PRIVATE_ME + 1)
+
+/* subcodes are '0'..('0'+QCS_SCHEMA_SUBCODES-1) */
+#define QCS_SCHEMA_SUBCODES	4
+
+/* QCS_SCHEMA_*(X):
+ *	X(msgid, opcode, subcode, fields, consts) for every message:
+ *	subcode is the second byte for 'H'/'J' messages (0 if none),
+ *	consts - '\0' separated strings for QCS_F_CONST fields
+ *
+ *	QCS_SCHEMA_COMMON is shared by both protocols, QCS_SCHEMA_QCHAT
+ *	and QCS_SCHEMA_VYPRESS hold layouts, that differ between them
+ */
+#define QCS_SCHEMA_COMMON(X) \
+	X(REFRESH_REQUEST,	'0', 0,	QCS_F_SRC, "") \
+	X(REFRESH_ACK,		'1', 0,	QCS_F_DST QCS_F_SRC QCS_F_MODE QCS_F_OWATCH, "") \
+	X(CHANNEL_BROADCAST,	'2', 0,	QCS_F_CHAN QCS_F_SRC QCS_F_TEXT, "") \
+	X(RENAME,		'3', 0,	QCS_F_SRC QCS_F_TEXT QCS_F_PAD, "") \
+	X(CHANNEL_JOIN,		'4', 0,	QCS_F_SRC QCS_F_CHAN QCS_F_MODE QCS_F_PAD, "") \
+	X(CHANNEL_LEAVE,	'5', 0,	QCS_F_SRC QCS_F_CHAN QCS_F_PAD, "") \
+	X(MESSAGE_SEND,		'6', 0,	QCS_F_SRC QCS_F_DST QCS_F_TEXT, "") \
+	X(MESSAGE_ACK,		'7', 0,	QCS_F_MODE QCS_F_DST QCS_F_SRC QCS_F_ZERO QCS_F_TEXT, "") \
+	X(CHANNEL_ME,		'A', 0,	QCS_F_CHAN QCS_F_SRC QCS_F_TEXT, "") \
+	X(MODE_CHANGE,		'D', 0,	QCS_F_SRC QCS_F_MODE QCS_F_PAD, "") \
+	X(MESSAGE_MASS,		'E', 0,	QCS_F_SRC QCS_F_DST QCS_F_TEXT, "") \
+	X(INFO_REQUEST,		'F', 0,	QCS_F_DST QCS_F_SRC, "") \
+	X(BEEP_SEND,		'H', '0', QCS_F_DST QCS_F_SRC, "") \
+	X(BEEP_ACK,		'H', '1', QCS_F_DST QCS_F_SRC QCS_F_PAD, "") \
+	X(PRIVATE_OPEN,		'J', '0', QCS_F_SRC QCS_F_DST QCS_F_PAD, "") \
+	X(PRIVATE_CLOSE,	'J', '1', QCS_F_SRC QCS_F_DST QCS_F_PAD, "") \
+	X(PRIVATE_TEXT,		'J', '2', QCS_F_SRC QCS_F_DST QCS_F_TEXT, "") \
+	X(PRIVATE_ME,		'J', '3', QCS_F_SRC QCS_F_DST QCS_F_TEXT, "") \
+	X(CHANMEMBER_REPLY,	'K', 0,	QCS_F_DST QCS_F_CHANS QCS_F_SRC, "") \
+	X(CHANMEMBER_REQUEST,	'L', 0,	QCS_F_SRC, "") \
+	X(WATCH_CHANGE,		'M', 0,	QCS_F_SRC QCS_F_WATCH, "") \
+	X(CHANLIST_REQUEST,	'N', 0,	QCS_F_SRC, "") \
+	X(CHANLIST_REPLY,	'O', 0,	QCS_F_DST QCS_F_CHANS, "")
+
+/* qchat 1.x knows the topic of "Main" only */
+#define QCS_SCHEMA_QCHAT(X) \
+	X(TOPIC_CHANGE,		'B', 0,	QCS_F_MAIN QCS_F_TEXT, "") \
+	X(TOPIC_REPLY,		'C', 0,	QCS_F_DST QCS_F_TEXT QCS_F_MAIN, "") \
+	X(INFO_REPLY,		'G', 0,	QCS_F_DST QCS_F_SRC QCS_F_TEXT \
+		QCS_F_CONST QCS_F_CONST QCS_F_CONST QCS_F_CHANS QCS_F_SUPP, \
+		"QcProto1.6\0" "0 %\0" "0 Kb")
+
+#define QCS_SCHEMA_VYPRESS(X) \
+	X(TOPIC_CHANGE,		'B', 0,	QCS_F_CHAN QCS_F_TEXT, "") \
+	X(TOPIC_REPLY,		'C', 0,	QCS_F_DST QCS_F_CHAN QCS_F_TEXT, "") \
+	X(INFO_REPLY,		'G', 0,	QCS_F_DST QCS_F_SRC QCS_F_TEXT \
+		QCS_F_CONST QCS_F_CONST QCS_F_CHANS QCS_F_SUPP, \
+		"VcProto1.0\0" "0.0.0.0")
+
+#endif	/* QCS_SCHEMA_H */
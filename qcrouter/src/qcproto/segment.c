@@ -0,0 +1,365 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	in-process network segment, for links opened with
+ *	QCS_BACKEND_SEGMENT: sendmmsg()/recvmmsg() look-alikes,
+ *	that copy datagrams between host queues
+ */
+
+#define _GNU_SOURCE	/* struct mmsghdr, struct in_pktinfo */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+
+#include "segment.h"
+
+/* qcs__seg_dgram:
+ *	datagram in a host queue (its data is in the host buffer) */
+struct qcs__seg_dgram {
+	size_t len;		/* bytes in the buffer */
+	int truncated;		/* ... of a longer datagram */
+	struct sockaddr_in src;
+	unsigned long dst;	/* host byte order */
+	struct timespec stamp;
+};
+
+static void seg_lock(struct qcs__segment * seg)
+{
+	while(__atomic_test_and_set(&seg->lock, __ATOMIC_ACQUIRE)) {
+		sched_yield();
+	}
+}
+
+static void seg_unlock(struct qcs__segment * seg)
+{
+	__atomic_clear(&seg->lock, __ATOMIC_RELEASE);
+}
+
+/* qcs__seg_init:
+ *	sets up empty segment	*/
+void qcs__seg_init(struct qcs__segment * seg)
+{
+	memset(seg, 0, sizeof(struct qcs__segment));
+	seg->next_host = 1;
+}
+
+/* qcs__seg_attach:
+ *	attaches host to segment, on port, with a queue of `queue_size'
+ *	datagrams up to `dgram_size' bytes long; the host gets the
+ *	next address of the segment	*/
+int qcs__seg_attach(
+	struct qcs__segment * seg,
+	struct qcs__seg_host * host,
+	unsigned short port,
+	unsigned int queue_size,
+	size_t dgram_size )
+{
+	memset(host, 0, sizeof(struct qcs__seg_host));
+	host->fd = eventfd(0, EFD_CLOEXEC);
+	if(host->fd < 0) {
+		return 0;
+	}
+
+	host->bufs = malloc(queue_size * dgram_size);
+	host->dgrams = malloc(queue_size * sizeof(struct qcs__seg_dgram));
+	if(!host->bufs || !host->dgrams) {
+		free(host->bufs);
+		free(host->dgrams);
+		close(host->fd);
+		errno = ENOMEM;
+		return 0;
+	}
+	host->queue_size = queue_size;
+	host->dgram_size = dgram_size;
+	host->port = port;
+	host->seg = seg;
+
+	seg_lock(seg);
+	host->addr = QCS_SEGMENT_NET + seg->next_host++;
+	host->next = seg->hosts;
+	seg->hosts = host;
+	seg_unlock(seg);
+
+	return 1;
+}
+
+/* qcs__seg_detach:
+ *	detaches host from its segment, dropping what it has queued */
+void qcs__seg_detach(struct qcs__seg_host * host)
+{
+	struct qcs__seg_host ** p_host;
+
+	seg_lock(host->seg);
+	for(p_host = &host->seg->hosts; *p_host; p_host = &(*p_host)->next) {
+		if(*p_host==host) {
+			*p_host = host->next;
+			break;
+		}
+	}
+	seg_unlock(host->seg);
+
+	close(host->fd);
+	free(host->bufs);
+	free(host->dgrams);
+}
+
+/* deliver:
+ *	queues datagram gathered from iov on host (under segment lock) */
+static void deliver(
+	struct qcs__seg_host * host,
+	const struct msghdr * msg,
+	const struct sockaddr_in * src,
+	unsigned long dst,
+	const struct timespec * stamp )
+{
+	struct qcs__seg_dgram * dgram;
+	unsigned int slot;
+	size_t i, chunk;
+	char * buf;
+
+	if(host->count==host->queue_size) {
+		host->drops ++;
+		return;
+	}
+
+	slot = (host->head + host->count) % host->queue_size;
+	dgram = host->dgrams + slot;
+	buf = host->bufs + slot * host->dgram_size;
+
+	dgram->len = 0;
+	dgram->truncated = 0;
+	for(i = 0; i < msg->msg_iovlen; i++) {
+		chunk = msg->msg_iov[i].iov_len;
+		if(chunk > host->dgram_size - dgram->len) {
+			chunk = host->dgram_size - dgram->len;
+			dgram->truncated = 1;
+		}
+		memcpy(buf + dgram->len, msg->msg_iov[i].iov_base, chunk);
+		dgram->len += chunk;
+	}
+	dgram->src = *src;
+	dgram->dst = dst;
+	dgram->stamp = *stamp;
+
+	/* the queue gets readable */
+	if(host->count++==0) {
+		eventfd_write(host->fd, 1);
+	}
+}
+
+/* qcs__seg_sendmmsg:
+ *	sends `count' datagrams from host, as sendmmsg() does: to the
+ *	host of the destination address, or to every host on the
+ *	destination port (the sender included), if none has it;
+ *	datagrams, that find a queue full, are dropped there
+ * returns:
+ *	number of datagrams sent, -1 if the first one fails	*/
+int qcs__seg_sendmmsg(
+	struct qcs__seg_host * host,
+	struct mmsghdr * hdrs,
+	unsigned int count )
+{
+	struct qcs__segment * seg = host->seg;
+	struct qcs__seg_host * to;
+	struct sockaddr_in src, dst;
+	struct timespec stamp;
+	unsigned long dst_addr;
+	unsigned short dst_port;
+	unsigned int i;
+	size_t j;
+	int unicast;
+
+	memset(&src, 0, sizeof(src));
+	src.sin_family = AF_INET;
+	src.sin_addr.s_addr = htonl(host->addr);
+	src.sin_port = htons(host->port);
+	clock_gettime(CLOCK_REALTIME, &stamp);
+
+	seg_lock(seg);
+	for(i = 0; i < count; i++) {
+		if(hdrs[i].msg_hdr.msg_name==NULL
+			|| hdrs[i].msg_hdr.msg_namelen < sizeof(dst))
+		{
+			break;
+		}
+		memcpy(&dst, hdrs[i].msg_hdr.msg_name, sizeof(dst));
+		dst_addr = ntohl(dst.sin_addr.s_addr);
+		dst_port = ntohs(dst.sin_port);
+		unicast = dst_addr > QCS_SEGMENT_NET
+			&& dst_addr < QCS_SEGMENT_NET + seg->next_host;
+
+		for(to = seg->hosts; to; to = to->next) {
+			if(to->port==dst_port
+				&& (!unicast || to->addr==dst_addr))
+			{
+				deliver(to, &hdrs[i].msg_hdr, &src,
+					dst_addr, &stamp);
+			}
+		}
+
+		hdrs[i].msg_len = 0;
+		for(j = 0; j < hdrs[i].msg_hdr.msg_iovlen; j++) {
+			hdrs[i].msg_len += hdrs[i].msg_hdr.msg_iov[j].iov_len;
+		}
+	}
+	seg_unlock(seg);
+
+	if(i==0 && count) {
+		errno = EDESTADDRREQ;
+		return -1;
+	}
+	return i;
+}
+
+/* put_cmsg:
+ *	appends control message to msg, if there is room for it */
+static void put_cmsg(
+	struct msghdr * msg,
+	size_t * p_used,
+	int level, int type,
+	const void * data, size_t len )
+{
+	struct cmsghdr * cmsg;
+
+	if(*p_used + CMSG_SPACE(len) > msg->msg_controllen) {
+		msg->msg_flags |= MSG_CTRUNC;
+		return;
+	}
+	cmsg = (struct cmsghdr *)((char *)msg->msg_control + *p_used);
+	memset(cmsg, 0, CMSG_SPACE(len));
+	cmsg->cmsg_level = level;
+	cmsg->cmsg_type = type;
+	cmsg->cmsg_len = CMSG_LEN(len);
+	memcpy(CMSG_DATA(cmsg), data, len);
+	*p_used += CMSG_SPACE(len);
+}
+
+/* take:
+ *	moves head of the host queue into msg, along with what
+ *	SO_TIMESTAMPNS, IP_PKTINFO & SO_RXQ_OVFL would have reported
+ *	(under segment lock)
+ * returns:
+ *	bytes received	*/
+static unsigned int take(
+	struct qcs__seg_host * host,
+	struct msghdr * msg )
+{
+	struct qcs__seg_dgram * dgram = host->dgrams + host->head;
+	const char * buf = host->bufs + host->head * host->dgram_size;
+	struct in_pktinfo pktinfo;
+	uint32_t drops;
+	size_t i, chunk, copied = 0, used = 0;
+
+	msg->msg_flags = 0;
+	for(i = 0; i < msg->msg_iovlen && copied < dgram->len; i++) {
+		chunk = msg->msg_iov[i].iov_len;
+		if(chunk > dgram->len - copied) {
+			chunk = dgram->len - copied;
+		}
+		memcpy(msg->msg_iov[i].iov_base, buf + copied, chunk);
+		copied += chunk;
+	}
+	if(copied < dgram->len || dgram->truncated) {
+		msg->msg_flags |= MSG_TRUNC;
+	}
+
+	if(msg->msg_name!=NULL && msg->msg_namelen >= sizeof(dgram->src)) {
+		memcpy(msg->msg_name, &dgram->src, sizeof(dgram->src));
+		msg->msg_namelen = sizeof(dgram->src);
+	}
+
+	if(msg->msg_control!=NULL) {
+		memset(&pktinfo, 0, sizeof(pktinfo));
+		pktinfo.ipi_spec_dst.s_addr = htonl(host->addr);
+		pktinfo.ipi_addr.s_addr = htonl(dgram->dst);
+		drops = host->drops;
+
+		put_cmsg(msg, &used, SOL_SOCKET, SCM_TIMESTAMPNS,
+			&dgram->stamp, sizeof(dgram->stamp));
+		put_cmsg(msg, &used, IPPROTO_IP, IP_PKTINFO,
+			&pktinfo, sizeof(pktinfo));
+		put_cmsg(msg, &used, SOL_SOCKET, SO_RXQ_OVFL,
+			&drops, sizeof(drops));
+	}
+	msg->msg_controllen = used;
+
+	host->head = (host->head + 1) % host->queue_size;
+	host->count --;
+	return copied;
+}
+
+/* qcs__seg_recvmmsg:
+ *	receives up to `count' datagrams queued on host, as recvmmsg()
+ *	with MSG_WAITFORONE does: waits for the first one, unless
+ *	MSG_DONTWAIT is given or host fd is O_NONBLOCK
+ * returns:
+ *	number of datagrams received, -1 on error (EAGAIN: none)	*/
+int qcs__seg_recvmmsg(
+	struct qcs__seg_host * host,
+	struct mmsghdr * hdrs,
+	unsigned int count,
+	int flags )
+{
+	struct pollfd pfd;
+	eventfd_t value;
+	unsigned int n;
+
+	for(;;) {
+		seg_lock(host->seg);
+		for(n = 0; n < count && host->count; n++) {
+			hdrs[n].msg_len = take(host, &hdrs[n].msg_hdr);
+		}
+		if(n && !host->count) {
+			/* drained: fd is not readable any more */
+			eventfd_read(host->fd, &value);
+		}
+		seg_unlock(host->seg);
+
+		if(n || !count) {
+			return n;
+		}
+
+		if((flags & MSG_DONTWAIT)
+			|| (fcntl(host->fd, F_GETFL) & O_NONBLOCK))
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+
+		pfd.fd = host->fd;
+		pfd.events = POLLIN;
+		if(poll(&pfd, 1, -1) < 0) {
+			/* EINTR, as recvmmsg() would */
+			return -1;
+		}
+	}
+}
@@ -0,0 +1,72 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	in-process network segment: links of one process exchanging
+ *	datagrams in memory, as hosts on a LAN segment would
+ */
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+struct mmsghdr;
+struct qcs__seg_dgram;
+struct qcs__seg_host;
+
+/* first host address on a segment: 10.0.0.1 (host byte order) */
+#define QCS_SEGMENT_NET	0x0a000000UL
+
+/* qcs__segment:
+ *	hosts, that see each other's datagrams; hosts are attached
+ *	& detached and send from different threads, under lock */
+struct qcs__segment {
+	char lock;		/* spinlock */
+	struct qcs__seg_host * hosts;
+	unsigned long next_host;	/* host part of the next address */
+};
+
+/* qcs__seg_host:
+ *	host on a segment, bound to a port: receives datagrams into
+ *	its queue, fd (eventfd) is readable while the queue is not
+ *	empty. A datagram goes to the host it is addressed to, or, if
+ *	to none (broadcast/multicast), to every host on the port */
+struct qcs__seg_host {
+	struct qcs__segment * seg;
+	struct qcs__seg_host * next;
+	int fd;
+	unsigned long addr;	/* host byte order */
+	unsigned short port;
+
+	unsigned int queue_size;	/* datagrams */
+	size_t dgram_size;	/* max bytes, longer ones are truncated */
+	char * bufs;		/* queue_size buffers of dgram_size bytes */
+	struct qcs__seg_dgram * dgrams;
+	unsigned int head, count;
+	unsigned int drops;	/* datagrams, that found the queue full */
+};
+
+void qcs__seg_init(struct qcs__segment *);
+int qcs__seg_attach(struct qcs__segment *, struct qcs__seg_host *,
+		unsigned short, unsigned int, size_t);
+void qcs__seg_detach(struct qcs__seg_host *);
+int qcs__seg_sendmmsg(struct qcs__seg_host *, struct mmsghdr *, unsigned int);
+int qcs__seg_recvmmsg(struct qcs__seg_host *, struct mmsghdr *,
+		unsigned int, int);
+
+#endif	/* SEGMENT_H */
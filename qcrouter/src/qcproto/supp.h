@@ -32,15 +32,63 @@ int qcs__local_qcmode(int);
 int qcs__net_qcmode(int);
 #define qcs__net_qcwatch(m) (((m)&QCS_UMODE_WATCH)?'1':'2')
 void qcs__cleanupmsg(qcs_msg *);
-char * qcs__gatherstr(const char **, int *);
+
+/* qcs__msg_store:
+ *	field buffers of a message: each starts inline and is replaced
+ *	by a malloc'ed one, when a longer string has to fit */
+#define QCS_MSG_FIELDS	5	/* by enum qcs_textid */
+#define QCS_MSG_INLINE	32
+
+struct qcs__msg_store {
+	char * bufs[QCS_MSG_FIELDS];
+	unsigned int caps[QCS_MSG_FIELDS];
+	char inline_bufs[QCS_MSG_FIELDS][QCS_MSG_INLINE];
+	qcs_msg * next;		/* next free message in the pool */
+};
+
+qcs_msg * qcs__allocmsg();
+void qcs__freemsg(qcs_msg *);
+int qcs__setfield(qcs_msg *, enum qcs_textid, const char *, int);
+int qcs__index_fields(const char *, int, unsigned short *);
+int qcs__materialize(const qcs_msg_view *, qcs_msg *);
+void qcs__viewmsg(const qcs_msg *, qcs_msg_view *);
+
+/* qcs__filter:
+ *	receive filter of a link (fn==NULL if none) */
+struct qcs__filter {
+	qcs_recv_filter fn;
+	void * data;
+	unsigned long long dropped;	/* datagrams dropped by fn */
+};
+
+/* QCS_COUNT:
+ *	adds n to a statistics counter. Every counter has a single
+ *	writer (the thread driving its link), so the update is a plain
+ *	load & store, that other threads read without tearing */
+#define QCS_COUNT(counter, n) \
+	__atomic_store_n(&(counter), \
+		__atomic_load_n(&(counter), __ATOMIC_RELAXED) + (n), \
+		__ATOMIC_RELAXED)
 
 /* vypress chat protocol signature stuff */
-#define QCS_SIGNATURE_LENGTH	(9)
+/* qcs__dup_cache:
+ *	vypress chat duplicate detection cache: ring of the last
+ *	`size' signatures seen, indexed by open-addressing hash table */
+struct qcs__dup_cache {
+	unsigned int size;		/* ring capacity */
+	unsigned int count, head;	/* entries in ring, next to (over)write */
+	char * ring;			/* size signatures */
+	unsigned int * hashes;		/* hash of each ring entry */
+	int * table;			/* ring entry or -1 (mask+1 slots) */
+	unsigned int mask;
+	unsigned long long hits;	/* duplicates found, ever */
+};
 
-int qcs__known_dup_entry(const char *);
-void qcs__remove_last_entry();
-int qcs__insert_dup_entry(const char *);
-void qcs__generate_signature(char *);
-int qcs__cleanup_dup();
+int qcs__dup_init(struct qcs__dup_cache *, unsigned int);
+void qcs__dup_free(struct qcs__dup_cache *);
+void qcs__dup_flush(struct qcs__dup_cache *);
+int qcs__dup_check(struct qcs__dup_cache *, const char *);
+void qcs__seed_signature(unsigned int *, const void *);
+void qcs__generate_signature(char *, unsigned int *);
 
 #endif	/* SUPP_H */
@@ -0,0 +1,69 @@
+/**
+ * qcs_link: Vypress/QChat protocol interface library
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+/*
+ * QCS: qChat 1.6/VypressChat link interface
+ *
+ *	io_uring module: rings set up & driven with raw syscalls
+ */
+
+#ifndef URING_H
+#define URING_H
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+/* qcs__uring:
+ *	io_uring instance: submission & completion rings mapped from
+ *	the kernel and, optionally, ring of buffers provided to it
+ *	(buffer group 0), that receives pick from */
+struct qcs__uring {
+	int fd;
+
+	void * rings;		/* sq & cq rings (single mmap) */
+	size_t rings_size;
+	struct io_uring_sqe * sqes;
+	size_t sqes_size;
+
+	unsigned int * sq_khead, * sq_ktail, * sq_array;
+	unsigned int sq_mask, sq_entries;
+	unsigned int sq_tail;	/* sqes filled in, not all published */
+
+	unsigned int * cq_khead, * cq_ktail;
+	unsigned int cq_mask;
+	struct io_uring_cqe * cqes;
+
+	struct io_uring_buf_ring * br;	/* NULL, if no buffers */
+	unsigned int buf_count;		/* a power of 2 */
+	unsigned int br_tail;
+	char * bufs;		/* buf_count buffers, buf_size bytes each */
+	size_t buf_size;
+};
+
+#define QCS__URING_BUF(ring, bid)	((ring)->bufs + (bid) * (ring)->buf_size)
+
+int qcs__uring_init(struct qcs__uring *, unsigned int, unsigned int);
+void qcs__uring_free(struct qcs__uring *);
+int qcs__uring_setup_bufs(struct qcs__uring *, unsigned int, size_t);
+void qcs__uring_put_buf(struct qcs__uring *, unsigned int);
+struct io_uring_sqe * qcs__uring_sqe(struct qcs__uring *);
+int qcs__uring_submit(struct qcs__uring *, unsigned int);
+struct io_uring_cqe * qcs__uring_cqe(struct qcs__uring *);
+void qcs__uring_cqe_seen(struct qcs__uring *);
+
+#endif	/* URING_H */
@@ -57,6 +57,8 @@ void route_loop();
 
 struct pollfd * build_poll_table(unsigned int *);
 qnet * poll_select_net(struct pollfd *, unsigned int, unsigned short *);
+int flush_tx_nets(struct pollfd *, unsigned int);
+void watch_tx_nets(struct pollfd *, unsigned int);
 int process_net_event(qnet *, unsigned short);
 
 qnet ** make_no_rx_networks_list();
@@ -160,6 +162,7 @@ void route_loop()
 		}
 		
 		/* wait for events & signals */
+		watch_tx_nets(pfd, pfd_size);
 		if(poll(pfd, pfd_size, -1)==-1) {
 			if(timer_ignited) {
 				timer_process();
@@ -172,6 +175,11 @@ void route_loop()
 			continue;
 		}
 
+		/* send what paced nets may send by now */
+		if(!flush_tx_nets(pfd, pfd_size)) {
+			continue;
+		}
+
 		net = poll_select_net(pfd, pfd_size, &revents);
 
 		if(net==NULL) {
@@ -303,8 +311,90 @@ qnet * poll_select_net(
 	return net;
 }
 
+/** tx_net_of
+ *	returns net, which tx timer/socket the fd is (or NULL)
+ */
+static qnet * tx_net_of(qnet ** net_list, int fd)
+{
+	for(; *net_list; net_list++) {
+		if((*net_list)->flush
+			&& ((*net_list)->get_prop(*net_list, QNETPROP_TX_TIMER)==fd
+			|| (*net_list)->get_prop(*net_list, QNETPROP_TX_SOCKET)==fd))
+		{
+			return *net_list;
+		}
+	}
+	return NULL;
+}
+
+/** watch_tx_nets
+ *	sets up polling of tx sockets: POLLOUT for the nets,
+ *	which output is blocked on a full socket buffer
+ */
+void watch_tx_nets(
+	struct pollfd * pfds,
+	unsigned int pfds_count)
+{
+	qnet ** net_list, ** p_net;
+	unsigned int i;
+	int sock, events;
+
+	net_list = net_enum(NULL);
+
+	for(p_net = net_list; *p_net; p_net++) {
+		if(!(*p_net)->flush) {
+			continue;
+		}
+		sock = (*p_net)->get_prop(*p_net, QNETPROP_TX_SOCKET);
+		events = (*p_net)->get_prop(*p_net, QNETPROP_TX_BLOCKED)
+			? POLLOUT: 0;
+
+		for(i = 0; i < pfds_count; i++) {
+			if(pfds[i].fd==sock) {
+				pfds[i].events = events;
+			}
+		}
+	}
+
+	xfree(net_list);
+}
+
+/** flush_tx_nets
+ *	flushes nets, which tx timers have gone off (or tx
+ *	sockets got writable), and clears `revents' of those
+ * returns:
+ *	non-zero, if other pfds have events left
+ */
+int flush_tx_nets(
+	struct pollfd * pfds,
+	unsigned int pfds_count)
+{
+	qnet ** net_list, * net;
+	int left = 0;
+
+	net_list = net_enum(NULL);
+
+	for(; pfds_count--; pfds++) {
+		if(!pfds->revents) {
+			continue;
+		}
+
+		net = tx_net_of(net_list, pfds->fd);
+		if(net) {
+			net->flush(net);
+			pfds->revents = 0;
+		} else {
+			left = 1;
+		}
+	}
+
+	xfree(net_list);
+	return left;
+}
+
 /** build_poll_table
  * 	build pollfd's of current net rx sockets
+ *	(and tx timers & sockets of the nets, that queue their output)
  */
 struct pollfd *
 build_poll_table(
@@ -320,10 +410,6 @@ build_poll_table(
 
 	if(host_enabled()) count ++;
 
-	if(p_pfd_num) {
-		*p_pfd_num = count;
-	}
-
 	if(count==0) {
 		/** no active net links found;
 		 * err.. this is unusable configuration,
@@ -331,8 +417,9 @@ build_poll_table(
 		panic("no active connections present and hosting not enabled");
 	}
 
-	/* setup poll table */
-	pfds = xalloc(sizeof(struct pollfd)*count);
+	/* setup poll table: rx socket, tx timer & socket
+	 * of every net, at most */
+	pfds = xalloc(sizeof(struct pollfd)*count*3);
 	p = pfds;
 	if(host_enabled()) {
 		p->fd = host_get_prop(QNETPROP_RX_SOCKET);
@@ -351,9 +438,30 @@ build_poll_table(
 			p->events = POLLIN;
 			p++;
 		}
+
+		if((*p_net)->flush) {
+			sock = (*p_net)->get_prop(*p_net, QNETPROP_TX_TIMER);
+			if(sock >= 0) {
+				p->fd = sock;
+				p->events = POLLIN;
+				p++;
+			}
+
+			/* events are set up by watch_tx_nets() */
+			sock = (*p_net)->get_prop(*p_net, QNETPROP_TX_SOCKET);
+			if(sock >= 0) {
+				p->fd = sock;
+				p->events = 0;
+				p++;
+			}
+		}
 		p_net++;
 	}
 
+	if(p_pfd_num) {
+		*p_pfd_num = p - pfds;
+	}
+
 	/* cleanup any unneded structs */
 	xfree(nets);
 
@@ -374,6 +482,7 @@ void do_connect()
 		switch(net->type) {
 		case QNETTYPE_VYPRESS_CHAT:
 		case QNETTYPE_QUICK_CHAT:
+		case QNETTYPE_AUTO_CHAT:
 			net_connect(net->type, net->broadcasts, net->port);
 			break;
 		case QNETTYPE_ROUTER:
@@ -240,6 +240,11 @@ static int routerconn_get_prop(
 		return NETCONN->socket;
 	case QNETPROP_DAMAGED:
 		return NETCONN->damaged;
+	case QNETPROP_TX_TIMER:
+	case QNETPROP_TX_SOCKET:
+		return -1;
+	case QNETPROP_TX_BLOCKED:
+		return 0;
 	}
 
 	return 0;
@@ -355,6 +360,7 @@ qnet * router_connect(
 	net->recv = routerconn_recv;
 	net->get_prop = routerconn_get_prop;
 	net->set_prop = routerconn_set_prop;
+	net->flush = NULL;
 
 	return net;
 }
@@ -11,11 +11,23 @@
 #include <unistd.h>
 #include <netdb.h>
 
+#include "../qcproto/qcs_link.h"
+
 int passes(char * buf, unsigned buf_len)
 {
+	qcs_msg_peek peek;
+
 	assert(buf && buf_len);
 
-	return buf[0]!='1' && buf[0]!='0' && buf[0]!='M' && buf[0]!='C';
+	if(!qcs_peek(QCS_PROTO_QCHAT, buf, buf_len, &peek)) {
+		/* not a qchat msg: show it anyway */
+		return 1;
+	}
+
+	return peek.msg!=QCS_MSG_REFRESH_REQUEST
+		&& peek.msg!=QCS_MSG_REFRESH_ACK
+		&& peek.msg!=QCS_MSG_WATCH_CHANGE
+		&& peek.msg!=QCS_MSG_TOPIC_REPLY;
 }
 
 void normalize(unsigned char * buf, unsigned buf_len)
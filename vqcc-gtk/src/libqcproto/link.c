@@ -24,6 +24,8 @@
  * (c) Saulius Menkevicius 2001-2004
  */
 
+#define _GNU_SOURCE	/* recvmmsg() */
+
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,6 +43,7 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <netdb.h>
 #endif
@@ -131,6 +134,98 @@ link_setup_multicast(link_data * link)
 	return 0;	/* multicast setup */
 }
 
+/* link_setup_rx_buffers:
+ *	allocates receive buffers for the link
+ * returns:
+ *	non-0 on error
+ */
+static int
+link_setup_rx_buffers(link_data * link)
+{
+#ifndef WIN32
+	int i;
+
+	link->rx_hdrs = malloc(QCS_RECV_BATCH * sizeof(struct mmsghdr));
+	link->rx_iovs = malloc(QCS_RECV_BATCH * sizeof(struct iovec));
+	link->rx_addrs = malloc(QCS_RECV_BATCH * sizeof(struct sockaddr_in));
+#endif
+	link->rx_buf = malloc(QCS_RECV_BATCH * QCP_MAXUDPSIZE);
+
+#ifndef WIN32
+	if(!link->rx_buf || !link->rx_hdrs || !link->rx_iovs || !link->rx_addrs) {
+		free(link->rx_hdrs);
+		free(link->rx_iovs);
+		free(link->rx_addrs);
+#else
+	if(!link->rx_buf) {
+#endif
+		free(link->rx_buf);
+		return 1;
+	}
+
+#ifndef WIN32
+	/* point mmsghdr's at their buffer slots */
+	memset(link->rx_hdrs, 0, QCS_RECV_BATCH * sizeof(struct mmsghdr));
+	for(i = 0; i < QCS_RECV_BATCH; i++) {
+		link->rx_iovs[i].iov_base = link->rx_buf + i * QCP_MAXUDPSIZE;
+		link->rx_iovs[i].iov_len = QCP_MAXUDPSIZE;
+
+		link->rx_hdrs[i].msg_hdr.msg_iov = link->rx_iovs + i;
+		link->rx_hdrs[i].msg_hdr.msg_iovlen = 1;
+		link->rx_hdrs[i].msg_hdr.msg_name = link->rx_addrs + i;
+	}
+#endif
+	return 0;
+}
+
+static void
+link_free_rx_buffers(link_data * link)
+{
+	free(link->rx_buf);
+#ifndef WIN32
+	free(link->rx_hdrs);
+	free(link->rx_iovs);
+	free(link->rx_addrs);
+#endif
+}
+
+/* link_parse_datagram:
+ *	parses datagram received on the link into msg
+ */
+static int
+link_parse_datagram(
+	link_data * link,
+	char * buff, ssize_t dgram_size,
+	const struct sockaddr_in * sa,
+	qcs_msg * msg)
+{
+	/* fill in message source address */
+	msg->src_ip = ntohl(sa->sin_addr.s_addr);
+
+	if(dgram_size <= 0) {
+		errno = ENOMSG;
+		return 0;
+	}
+	
+	/* check if msg is too long for us to process:
+	 * just strip it down. we guess this was the last
+	 * ascii field, in proto msg, that was soo long.
+	 */
+	if(dgram_size >= QCP_MAXUDPSIZE)
+		*(char*)(buff+QCP_MAXUDPSIZE-1) = '\0';
+
+	switch(link->proto) {
+	case QCS_PROTO_QCHAT:
+		return qcs__parse_qchat_msg(buff, dgram_size, msg);
+	case QCS_PROTO_VYPRESS:
+		return qcs__parse_vypress_msg(buff, dgram_size, msg);
+	default: break;
+	}
+
+	errno = ENOSYS;
+	return 0;
+}
+
 /** API implementation			*/
 qcs_link qcs_open(
 	enum qcs_proto proto,
@@ -210,6 +305,15 @@ qcs_link qcs_open(
 		return NULL;
 	}
 
+	/* setup receive buffers */
+	if(link_setup_rx_buffers(link)) {
+		close(link->tx);
+		close(link->rx);
+		free(link);
+		errno = ENOMEM;
+		return NULL;
+	}
+
 	/* increase link count */
 	link_count ++;
 
@@ -228,6 +332,7 @@ int qcs_close(qcs_link link_id)
 	/* shutdown sockets and free the struct */
 	close(link->rx);
 	close(link->tx);
+	link_free_rx_buffers(link);
 	free(link);
 
 	link_count--;
@@ -332,15 +437,14 @@ int qcs_recv(
 	struct sockaddr_in sa;
 	socklen_t sa_len;
 	ssize_t dgram_size;
-	int parse_ok;
 
 	if(msg==NULL) ERRRET(EINVAL);
 
 	if(!VALID_ID(link_id)) ERRRET(EINVAL);
 	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
 
-	buff = (char*) malloc(QCP_MAXUDPSIZE+0x10);
-	if(buff==NULL) ERRRET(ENOMEM);
+	/* use first slot of the link's receive buffer */
+	buff = link->rx_buf;
 
 	/* receive data of the message */
 	sa_len = sizeof(sa);
@@ -349,36 +453,70 @@ int qcs_recv(
 		(struct sockaddr*)&sa, &sa_len
 	);
 	
-	/* fill in message source address */
-	msg->src_ip = ntohl(sa.sin_addr.s_addr);
-	
-	/* check if msg is too long for us to process:
-	 * just strip it down. we guess this was the last
-	 * ascii field, in proto msg, that was soo long.
-	 */
-	if(dgram_size > QCP_MAXUDPSIZE)
-		*(char*)(buff+QCP_MAXUDPSIZE-1) = '\0';
-
 	/* failure */
-	if(dgram_size < 0) {
-		free(buff);
+	if(dgram_size < 0)
 		return 0;
-	}
 
 	/* parse the message */
-	switch(link->proto) {
-	case QCS_PROTO_QCHAT:
-		parse_ok = qcs__parse_qchat_msg(buff, dgram_size, msg);
-		break;
-	case QCS_PROTO_VYPRESS:
-		parse_ok = qcs__parse_vypress_msg(buff, dgram_size, msg);
-		break;
-	default: break;
+	return link_parse_datagram(link, buff, dgram_size, &sa, msg);
+}
+
+int qcs_recv_batch(
+	qcs_link link_id,
+	qcs_msg ** msgs,
+	int max,
+	int * p_count )
+{
+	link_data * link = (link_data *)link_id;
+#ifndef WIN32
+	int i, received;
+#endif
+
+	if(msgs==NULL || p_count==NULL || max <= 0) ERRRET(EINVAL);
+
+	if(!VALID_ID(link_id)) ERRRET(EINVAL);
+	if(!ACTIVE_LINK(link)) ERRRET(EINVAL);
+
+	*p_count = 0;
+
+#ifdef WIN32
+	/* no recvmmsg() on win32: receive single message */
+	if(qcs_recv(link_id, msgs[0])) {
+		if(msgs[0]->msg!=QCS_MSG_INVALID)
+			*p_count = 1;
+	} else if(errno!=ENOMSG) {
+		return 0;
 	}
+#else
+	if(max > QCS_RECV_BATCH)
+		max = QCS_RECV_BATCH;
+
+	/* reset address lengths: recvmmsg() overwrites them */
+	for(i = 0; i < max; i++)
+		link->rx_hdrs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+
+	/* block for the first datagram only, take
+	 * whatever else is queued up without waiting
+	 */
+	received = recvmmsg(link->rx, link->rx_hdrs, max, MSG_WAITFORONE, NULL);
+	if(received < 0)
+		return 0;
 
-	/* cleanup */
-	free((void*)buff);
-	return parse_ok;
+	/* parse datagrams into msgs[], skipping malformed ones
+	 * and vypress duplicates (which parse into QCS_MSG_INVALID)
+	 */
+	for(i = 0; i < received; i++) {
+		if(link_parse_datagram(link,
+				link->rx_buf + i * QCP_MAXUDPSIZE,
+				link->rx_hdrs[i].msg_len,
+				link->rx_addrs + i, msgs[*p_count])
+			&& msgs[*p_count]->msg!=QCS_MSG_INVALID)
+		{
+			(*p_count) ++;
+		}
+	}
+#endif
+	return 1;
 }
 
 qcs_msg * qcs_newmsg()
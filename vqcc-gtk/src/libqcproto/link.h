@@ -29,6 +29,10 @@
 
 #define QCP_MAXUDPSIZE	0x2000
 
+/* max number of datagrams, that qcs_recv_batch() will drain
+ * with a single recvmmsg() call */
+#define QCS_RECV_BATCH	0x10
+
 /* windows compatibility hacks
  */
 #ifdef WIN32
@@ -46,6 +50,15 @@ typedef struct link_data_struct {
 	int rx, tx;			/* rx and tx sockets	*/
 	unsigned short port;		/* link port		*/
 	unsigned long broadcast_addr;	/* broadcast/multicast address */
+
+	/* receive buffers, reused on every qcs_recv/qcs_recv_batch:
+	 *	QCS_RECV_BATCH slots of QCP_MAXUDPSIZE bytes each */
+	char * rx_buf;
+#ifndef WIN32
+	struct mmsghdr * rx_hdrs;
+	struct iovec * rx_iovs;
+	struct sockaddr_in * rx_addrs;
+#endif
 } link_data;
 
 #endif	/* LINK_H */
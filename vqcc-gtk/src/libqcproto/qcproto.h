@@ -292,6 +292,23 @@ int qcs_recv(
 	qcs_link link,
 	qcs_msg * msg );
 
+/* qcs_recv_batch
+ *	retrieves up to `max' messages from the link with a single
+ *	syscall: blocks until at least one datagram is available,
+ *	then drains whatever is queued without waiting.
+ *	malformed datagrams and duplicates are skipped, thus
+ *	*p_count may be less than the number of datagrams read
+ *	(or even 0)
+ * returns:
+ *	non-0 on success,
+ *	0 on failure (see errno)
+ */
+int qcs_recv_batch(
+	qcs_link link,
+	qcs_msg ** msgs,	/* array of `max' allocated messages */
+	int max,
+	int * p_count );	/* number of messages filled in */
+
 /* qcs_newmsg
  * qcs_deletemsg
  *	(de)allocates & initializes new message struct	*/
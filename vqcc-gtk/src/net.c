@@ -34,6 +34,9 @@
 
 #define NET_DEFAULT_CHARSET "ISO-8859-1"
 
+/* max number of messages to handle per single socket wakeup */
+#define NET_RECV_BATCH	16
+
 /** static vars
   *************************/
 static qcs_link net;
@@ -585,14 +588,23 @@ net_io_func(
 	GIOCondition c,
 	gpointer data)
 {
-	qcs_msg * m;
+	qcs_msg * m[NET_RECV_BATCH];
+	int i, count;
 
 	switch(c) {
 	case G_IO_IN:
-		m = qcs_newmsg();
-		qcs_recv(net, m);
-		net_handle_netmsg(m);
-		qcs_deletemsg(m);
+		for(i = 0; i < NET_RECV_BATCH; i++)
+			m[i] = qcs_newmsg();
+
+		if(qcs_recv_batch(net, m, NET_RECV_BATCH, &count)) {
+			/* the net might get disconnected by
+			 * any of the message handlers */
+			for(i = 0; i < count && net; i++)
+				net_handle_netmsg(m[i]);
+		}
+
+		for(i = 0; i < NET_RECV_BATCH; i++)
+			qcs_deletemsg(m[i]);
 		break;
 	case G_IO_ERR:
 	case G_IO_HUP: